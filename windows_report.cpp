@@ -10,19 +10,271 @@
 
 #include <windows.h>
 #include <commctrl.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+// The BLE printer transport needs C++/WinRT (MSVC + Windows SDK); MinGW builds
+// compile without it and print to a file instead.
+#if defined(__has_include)
+#if __has_include(<winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>)
+#define ER_HAVE_WINRT_BLE 1
+#include <winrt/Windows.Foundation.h>
+#include <winrt/Windows.Devices.Bluetooth.h>
+#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
+#include <winrt/Windows.Storage.Streams.h>
+#pragma comment(lib, "windowsapp.lib")
+#endif
+#endif
+// The Direct2D/DirectWrite screen renderer only needs the SDK headers; the
+// DLLs are loaded at run time, so there is nothing extra to link.
+#if defined(__has_include)
+#if __has_include(<d2d1.h>) && __has_include(<dwrite.h>)
+#define ER_HAVE_D2D 1
+#include <d2d1.h>
+#include <dwrite.h>
+#endif
+#endif
+#include <shellapi.h>
 #include <stdint.h>
+#include <string.h>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 #include <chrono>
 #include <ctime>
-#include <sstream>
-#include <iomanip>
 // Added includes for math functions (sin, cos, ceil) and sorting
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <charconv>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <new>
 
 // Link common controls library
 #pragma comment(lib, "comctl32.lib")
+#pragma comment(lib, "shell32.lib")
+
+// ---- CPU dispatch ----
+// SIMD kernels are compiled for their target with ER_TARGET_AVX2 or
+// ER_TARGET_SSE2 and picked at run time, so the executable still runs on CPUs
+// without AVX2, and 32-bit builds on CPUs without SSE2.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ER_HAVE_X86_SIMD 1
+#if defined(__GNUC__) || defined(__clang__)
+#define ER_TARGET_AVX2 __attribute__((target("avx2")))
+#define ER_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define ER_TARGET_AVX2
+#define ER_TARGET_SSE2
+#endif
+#endif
+
+// Runtime CPU feature check, evaluated once
+bool cpuHasAvx2() {
+#if defined(ER_HAVE_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+    return has;
+#elif defined(ER_HAVE_X86_SIMD) && defined(_MSC_VER)
+    static const bool has = [] {
+        int r[4];
+        __cpuid(r, 0);
+        if (r[0] < 7) return false;
+        __cpuid(r, 1);
+        if (!(r[2] & (1 << 27)) || !(r[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(r, 7, 0);
+        return (r[1] & (1 << 5)) != 0;
+    }();
+    return has;
+#else
+    return false;
+#endif
+}
+
+// SSE2 is part of x86-64; only 32-bit builds have to ask the CPU
+bool cpuHasSse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(ER_HAVE_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("sse2") != 0);
+    return has;
+#elif defined(ER_HAVE_X86_SIMD) && defined(_MSC_VER)
+    static const bool has = [] {
+        int r[4];
+        __cpuid(r, 1);
+        return (r[3] & (1 << 26)) != 0;
+    }();
+    return has;
+#else
+    return false;
+#endif
+}
+
+
+// ---- Instrumentation ----
+// Scoped QueryPerformanceCounter timers around painting, the Draw* sections,
+// simulation and printing. Samples go into a lock-free ring that any thread
+// appends to, and that the F9 overlay and the --trace export read. While an
+// ETW session enables the provider, every sample is also written as an ETW
+// string event. Build with -DENERGY_REPORT_TRACE=0 to compile all of it out.
+#ifndef ENERGY_REPORT_TRACE
+#define ENERGY_REPORT_TRACE 1
+#endif
+
+enum TraceId {
+    TracePaint,
+    TraceSectionHeader,  // one per SectionId, in order
+    TraceSectionLine,
+    TraceSectionBar,
+    TraceSectionPie,
+    TraceSectionTable,
+    TraceSectionChecklist,
+    TraceSimulate,
+    TracePrintSubmit,
+    TracePrintBuild,     // value: job bytes
+    TracePrintSend,      // value: bytes sent
+    TraceCount
+};
+
+static const wchar_t* const kTraceNames[TraceCount] = {
+    L"paint", L"header", L"line", L"bar", L"pie", L"table", L"checklist", L"simulate", L"print.submit", L"print.build", L"print.send"
+};
+
+#if ENERGY_REPORT_TRACE
+#include <evntprov.h>
+#pragma comment(lib, "advapi32.lib")
+
+int64_t traceNow() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+double traceTicksToMs(int64_t ticks) {
+    static const double msPerTick = [] {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return 1000.0 / (double)f.QuadPart;
+    }();
+    return ticks * msPerTick;
+}
+
+// Fixed ring of the latest kSize samples. A writer claims a slot with one
+// fetch_add and publishes it by storing seq = index + 1 last; readers copy a
+// slot and keep it only if seq matched before and after the copy.
+class TraceRing {
+public:
+    static const size_t kSize = 4096;
+
+    struct Sample {
+        uint64_t index;
+        TraceId id;
+        uint32_t thread;
+        int64_t start;
+        int64_t ticks;
+        uint64_t value;
+    };
+
+    void Record(TraceId id, int64_t start, int64_t end, uint64_t value) {
+        uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& s = slots[index & (kSize - 1)];
+        s.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.idThread.store((uint64_t)id << 32 | GetCurrentThreadId(), std::memory_order_relaxed);
+        s.start.store(start, std::memory_order_relaxed);
+        s.ticks.store(end - start, std::memory_order_relaxed);
+        s.value.store(value, std::memory_order_relaxed);
+        s.seq.store(index + 1, std::memory_order_release);
+    }
+
+    // Up to max of the latest samples, oldest first; slots being rewritten
+    // are skipped
+    size_t Read(std::vector<Sample>& out, size_t max = kSize) const {
+        out.clear();
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = end > std::min(max, kSize) ? end - std::min(max, kSize) : 0;
+        for (uint64_t index = begin; index < end; ++index) {
+            const Slot& s = slots[index & (kSize - 1)];
+            if (s.seq.load(std::memory_order_acquire) != index + 1) continue;
+            uint64_t idThread = s.idThread.load(std::memory_order_relaxed);
+            Sample sample = { index, (TraceId)(idThread >> 32), (uint32_t)idThread,
+                s.start.load(std::memory_order_relaxed), s.ticks.load(std::memory_order_relaxed), s.value.load(std::memory_order_relaxed) };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != index + 1) continue;
+            out.push_back(sample);
+        }
+        return out.size();
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<uint64_t> idThread{ 0 };
+        std::atomic<int64_t> start{ 0 };
+        std::atomic<int64_t> ticks{ 0 };
+        std::atomic<uint64_t> value{ 0 };
+    };
+    std::atomic<uint64_t> head{ 0 };
+    Slot slots[kSize];
+};
+static TraceRing g_traceRing;
+
+// ETW provider "EnergyReport" {6B2D7C41-92A5-4E1B-9C1E-5A3F0D8E47B2}; enable
+// it with e.g. "tracelog -start er -guid #6B2D7C41-92A5-4E1B-9C1E-5A3F0D8E47B2"
+class TraceEtw {
+public:
+    ~TraceEtw() { Unregister(); }
+    void Register() {
+        static const GUID provider = { 0x6B2D7C41, 0x92A5, 0x4E1B, { 0x9C, 0x1E, 0x5A, 0x3F, 0x0D, 0x8E, 0x47, 0xB2 } };
+        if (!handle) EventRegister(&provider, NULL, NULL, &handle);
+    }
+    void Unregister() {
+        if (handle) EventUnregister(handle);
+        handle = 0;
+    }
+    void Write(TraceId id, int64_t ticks, uint64_t value) {
+        if (!handle || !EventProviderEnabled(handle, 4 /* informational */, 0)) return;
+        wchar_t text[96];
+        swprintf(text, 96, L"%ls %.3f ms %llu", kTraceNames[id], traceTicksToMs(ticks), (unsigned long long)value);
+        EventWriteString(handle, 4, 0, text);
+    }
+private:
+    REGHANDLE handle = 0;
+};
+static TraceEtw g_traceEtw;
+
+void traceRecord(TraceId id, int64_t start, int64_t end, uint64_t value = 0) {
+    g_traceRing.Record(id, start, end, value);
+    g_traceEtw.Write(id, end - start, value);
+}
+
+class ScopedTrace {
+public:
+    explicit ScopedTrace(TraceId id) : id(id), start(traceNow()) {}
+    ~ScopedTrace() { traceRecord(id, start, traceNow()); }
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+private:
+    TraceId id;
+    int64_t start;
+};
+
+#define ER_TRACE_CONCAT2(a, b) a##b
+#define ER_TRACE_CONCAT(a, b) ER_TRACE_CONCAT2(a, b)
+#define ER_TRACE_SCOPE(id) ScopedTrace ER_TRACE_CONCAT(traceScope, __LINE__)(id)
+// a sample from a QueryPerformanceCounter value taken earlier
+#define ER_TRACE_SINCE(id, startTicks, value) traceRecord((id), (startTicks), traceNow(), (value))
+#else
+#define ER_TRACE_SCOPE(id) ((void)0)
+#define ER_TRACE_SINCE(id, startTicks, value) ((void)0)
+#endif
 
 // ---- RNG implementation matching JS/Swift version ----
 class SeededRNG {
@@ -36,166 +288,4578 @@ public:
         state = state * a + c;
         return state;
     }
-    double nextDouble01() {
-        uint64_t v = next() >> 11;
-        // convert top 53 bits to [0,1)
-        return static_cast<double>(v) / static_cast<double>(1ULL << 53);
+    double nextDouble01() {
+        uint64_t v = next() >> 11;
+        // convert top 53 bits to [0,1)
+        return static_cast<double>(v) / static_cast<double>(1ULL << 53);
+    }
+private:
+    uint64_t state;
+};
+
+// Stateless counter-based generator: draw i of a stream is the SplitMix64
+// finalizer of key + (i + 1) * golden gamma, i.e. the value SplitMix64 would
+// return on its (i + 1)th call. Any building/day/sample is reachable without
+// replaying the sequence, so parallel generators agree with a serial run.
+class CounterRNG {
+public:
+    static const uint64_t kGamma = 0x9E3779B97F4A7C15ULL;
+
+    static uint64_t Mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    // Key of the stream for one building/day of a seed
+    static uint64_t Key(uint64_t seed, uint64_t building, int64_t day) {
+        return Mix(Mix(seed + building * kGamma) ^ (uint64_t)day);
+    }
+    // 52 random mantissa bits over 1.0, minus 1.0: [0,1) in one subtraction,
+    // which the vector kernels reproduce bit for bit
+    static double Unit(uint64_t bits) {
+        uint64_t one = (bits >> 12) | 0x3FF0000000000000ULL;
+        double v;
+        memcpy(&v, &one, sizeof(v));
+        return v - 1.0;
+    }
+
+    explicit CounterRNG(uint64_t key) : key(key) {}
+    uint64_t At(uint64_t counter) const { return Mix(key + (counter + 1) * kGamma); }
+    double Double01At(uint64_t counter) const { return Unit(At(counter)); }
+
+private:
+    uint64_t key;
+};
+
+// ---- UTF-8 names ----
+// Names from the store's building table and the CSV import are UTF-8; the
+// report draws UTF-16. internName converts each distinct name once with
+// MultiByteToWideChar and keeps it for the life of the process, so a day
+// only holds a view that costs nothing to copy or to draw. Built-in names
+// are wide literals and need no conversion at all.
+std::wstring utf8ToWide(const char* text, size_t length) {
+    if (length == 0) return std::wstring();
+    // invalid sequences become U+FFFD
+    int n = MultiByteToWideChar(CP_UTF8, 0, text, (int)length, NULL, 0);
+    std::wstring out(n > 0 ? n : 0, L'\0');
+    if (n > 0) MultiByteToWideChar(CP_UTF8, 0, text, (int)length, &out[0], n);
+    return out;
+}
+
+std::wstring_view internName(const std::string& utf8) {
+    static SRWLOCK lock = SRWLOCK_INIT;
+    // node-based: interned strings never move
+    static std::unordered_map<std::string, std::wstring> names;
+    AcquireSRWLockShared(&lock);
+    auto it = names.find(utf8);
+    std::wstring_view found = it != names.end() ? std::wstring_view(it->second) : std::wstring_view();
+    bool hit = it != names.end();
+    ReleaseSRWLockShared(&lock);
+    if (hit) return found;
+    std::wstring wide = utf8ToWide(utf8.data(), utf8.size());
+    AcquireSRWLockExclusive(&lock);
+    std::wstring_view view = names.emplace(utf8, std::move(wide)).first->second;
+    ReleaseSRWLockExclusive(&lock);
+    return view;
+}
+
+// ---- Data structures for energy report ----
+struct Consumer {
+    std::wstring_view name;
+    double kWh;
+};
+struct Category {
+    std::wstring_view name;
+    double kWh;
+};
+// Contiguous run of kWh samples that is cheap to copy. The samples live
+// either in a TimeSeriesStore mapping or in a buffer allocated by
+// SampleBuffer::Allocate(); the view keeps its backing memory alive, so
+// copying an EnergyDay never copies samples. Whether the samples may be
+// written is part of the type: SampleBuffer (double) is held only by the
+// code that owns a buffer, every EnergyDay carries read-only SampleViews
+// (const double), which is all a read-only mapping can back. A buffer
+// converts to a view, never the other way.
+template <typename T>
+class BasicSampleView {
+public:
+    BasicSampleView() = default;
+    BasicSampleView(std::shared_ptr<void> owner, T* data, size_t count)
+        : owner(std::move(owner)), ptr(data), count(count) {}
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    BasicSampleView(const BasicSampleView<U>& other) : owner(other.Owner()), ptr(other.data()), count(other.size()) {}
+    // Owned, zero-initialized, writable buffer of count samples
+    static BasicSampleView<double> Allocate(size_t count) {
+        std::shared_ptr<double> buf(new double[count](), std::default_delete<double[]>());
+        return BasicSampleView<double>(buf, buf.get(), count);
+    }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() const { return ptr; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + count; }
+    T& operator[](size_t i) const { return ptr[i]; }
+    const std::shared_ptr<void>& Owner() const { return owner; }
+private:
+    std::shared_ptr<void> owner;
+    T* ptr = nullptr;
+    size_t count = 0;
+};
+typedef BasicSampleView<double> SampleBuffer;
+typedef BasicSampleView<const double> SampleView;
+
+// ---- Aggregation kernels ----
+// Sum, extremes, threshold counts and resampling over sample runs, with AVX2
+// versions picked by cpuHasAvx2(). The scalar references accumulate in the
+// same four interleaved lanes as the vector code and combine them in the same
+// order, so both paths give bit-identical results.
+static const size_t kAggLanes = 4;
+
+double aggSumScalar(const double* v, size_t n) {
+    double lane[kAggLanes] = { 0.0, 0.0, 0.0, 0.0 };
+    size_t i = 0;
+    for (; i + kAggLanes <= n; i += kAggLanes) {
+        for (size_t k = 0; k < kAggLanes; ++k) lane[k] += v[i + k];
+    }
+    double sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    for (; i < n; ++i) sum += v[i];
+    return sum;
+}
+
+// Extremes of a run; ties resolve to the lowest index
+struct AggMinMax {
+    double min = 0.0;
+    size_t minIndex = 0;
+    double max = 0.0;
+    size_t maxIndex = 0;
+};
+
+AggMinMax aggMinMaxScalar(const double* v, size_t n) {
+    AggMinMax r;
+    if (!n) return r;
+    r.min = r.max = v[0];
+    for (size_t i = 1; i < n; ++i) {
+        if (v[i] < r.min) {
+            r.min = v[i];
+            r.minIndex = i;
+        }
+        if (v[i] > r.max) {
+            r.max = v[i];
+            r.maxIndex = i;
+        }
+    }
+    return r;
+}
+
+size_t aggCountAboveScalar(const double* v, size_t n, double threshold) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) count += v[i] > threshold;
+    return count;
+}
+
+#if defined(ER_HAVE_X86_SIMD)
+ER_TARGET_AVX2 double aggSumAvx2(const double* v, size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + kAggLanes <= n; i += kAggLanes) acc = _mm256_add_pd(acc, _mm256_loadu_pd(v + i));
+    alignas(32) double lane[kAggLanes];
+    _mm256_store_pd(lane, acc);
+    double sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    for (; i < n; ++i) sum += v[i];
+    return sum;
+}
+
+ER_TARGET_AVX2 AggMinMax aggMinMaxAvx2(const double* v, size_t n) {
+    if (n < 2 * kAggLanes) return aggMinMaxScalar(v, n);
+    // per-lane extremes and the index where each lane first saw them
+    __m256d vmin = _mm256_loadu_pd(v), vmax = vmin;
+    __m256d index = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+    __m256d imin = index, imax = index;
+    const __m256d step = _mm256_set1_pd((double)kAggLanes);
+    size_t i = kAggLanes;
+    for (; i + kAggLanes <= n; i += kAggLanes) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        index = _mm256_add_pd(index, step);
+        __m256d lt = _mm256_cmp_pd(x, vmin, _CMP_LT_OQ);
+        __m256d gt = _mm256_cmp_pd(x, vmax, _CMP_GT_OQ);
+        vmin = _mm256_blendv_pd(vmin, x, lt);
+        imin = _mm256_blendv_pd(imin, index, lt);
+        vmax = _mm256_blendv_pd(vmax, x, gt);
+        imax = _mm256_blendv_pd(imax, index, gt);
+    }
+    alignas(32) double mins[kAggLanes], maxs[kAggLanes], minIdx[kAggLanes], maxIdx[kAggLanes];
+    _mm256_store_pd(mins, vmin);
+    _mm256_store_pd(maxs, vmax);
+    _mm256_store_pd(minIdx, imin);
+    _mm256_store_pd(maxIdx, imax);
+    AggMinMax r;
+    r.min = mins[0];
+    r.minIndex = (size_t)minIdx[0];
+    r.max = maxs[0];
+    r.maxIndex = (size_t)maxIdx[0];
+    for (size_t k = 1; k < kAggLanes; ++k) {
+        size_t mi = (size_t)minIdx[k], ma = (size_t)maxIdx[k];
+        if (mins[k] < r.min || (mins[k] == r.min && mi < r.minIndex)) {
+            r.min = mins[k];
+            r.minIndex = mi;
+        }
+        if (maxs[k] > r.max || (maxs[k] == r.max && ma < r.maxIndex)) {
+            r.max = maxs[k];
+            r.maxIndex = ma;
+        }
+    }
+    for (; i < n; ++i) {
+        if (v[i] < r.min) {
+            r.min = v[i];
+            r.minIndex = i;
+        }
+        if (v[i] > r.max) {
+            r.max = v[i];
+            r.maxIndex = i;
+        }
+    }
+    return r;
+}
+
+ER_TARGET_AVX2 size_t aggCountAboveAvx2(const double* v, size_t n, double threshold) {
+    const __m256d t = _mm256_set1_pd(threshold);
+    size_t count = 0, i = 0;
+    for (; i + kAggLanes <= n; i += kAggLanes) {
+        int m = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(v + i), t, _CMP_GT_OQ));
+        count += (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + ((m >> 3) & 1);
+    }
+    return count + aggCountAboveScalar(v + i, n - i, threshold);
+}
+#endif
+
+double aggSum(const double* v, size_t n) {
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) return aggSumAvx2(v, n);
+#endif
+    return aggSumScalar(v, n);
+}
+
+AggMinMax aggMinMax(const double* v, size_t n) {
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) return aggMinMaxAvx2(v, n);
+#endif
+    return aggMinMaxScalar(v, n);
+}
+
+size_t aggCountAbove(const double* v, size_t n, double threshold) {
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) return aggCountAboveAvx2(v, n, threshold);
+#endif
+    return aggCountAboveScalar(v, n, threshold);
+}
+
+// Sum consecutive buckets of perBucket samples into dst (e.g. minute -> hour)
+void aggResample(const double* src, size_t buckets, size_t perBucket, double* dst) {
+    for (size_t b = 0; b < buckets; ++b) dst[b] = aggSum(src + b * perBucket, perBucket);
+}
+
+// Value at fraction p (0..1) of the sorted run, nearest rank. scratch is
+// resized to n; the run itself is left untouched.
+double aggPercentile(const double* v, size_t n, double p, std::vector<double>& scratch) {
+    if (!n) return 0.0;
+    scratch.assign(v, v + n);
+    size_t k = (size_t)std::min<double>((double)(n - 1), std::max(0.0, std::ceil(p * n) - 1.0));
+    std::nth_element(scratch.begin(), scratch.begin() + k, scratch.end());
+    return scratch[k];
+}
+
+// ---- Top-K selection ----
+// Rankings (top hours, top consumers) are by descending value with ties to
+// the lower id, i.e. the earlier hour or row, so they never depend on the
+// order a sort happens to visit equal values in.
+struct RankedItem {
+    double value;
+    uint32_t id;
+};
+
+inline bool rankedBefore(const RankedItem& a, const RankedItem& b) {
+    return a.value > b.value || (a.value == b.value && a.id < b.id);
+}
+
+// Streaming top-K: a bounded heap of the best k items offered so far, with
+// the worst of them on top, so each Offer() is O(log k) and nothing is ever
+// re-sorted. Items must not be offered twice; a value that went down needs a
+// new ranking from the full data.
+class TopK {
+public:
+    explicit TopK(size_t k) : k(k) { heap.reserve(k); }
+    void Clear() { heap.clear(); }
+    size_t Size() const { return heap.size(); }
+    bool Full() const { return k && heap.size() == k; }
+    // the item a newcomer has to beat once the heap is full
+    const RankedItem& Worst() const { return heap.front(); }
+
+    void Offer(uint32_t id, double value) {
+        RankedItem item = { value, id };
+        if (heap.size() < k) {
+            heap.push_back(item);
+            std::push_heap(heap.begin(), heap.end(), rankedBefore);
+        } else if (k && rankedBefore(item, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), rankedBefore);
+            heap.back() = item;
+            std::push_heap(heap.begin(), heap.end(), rankedBefore);
+        }
+    }
+
+    // Ranked ids, best first; returns the count written (Size())
+    template <typename Id>
+    size_t Sorted(Id* out) const {
+        RankedItem items[64];
+        std::vector<RankedItem> large;
+        RankedItem* sorted = items;
+        if (heap.size() > 64) {
+            large.assign(heap.begin(), heap.end());
+            sorted = large.data();
+        } else {
+            std::copy(heap.begin(), heap.end(), items);
+        }
+        std::sort(sorted, sorted + heap.size(), rankedBefore);
+        for (size_t i = 0; i < heap.size(); ++i) out[i] = (Id)sorted[i].id;
+        return heap.size();
+    }
+
+private:
+    size_t k;
+    std::vector<RankedItem> heap;
+};
+
+// Indices of the k largest of n values, best first. Returns min(k, n).
+// O(n log k) through the bounded heap, without an n-sized index array.
+template <typename Id>
+size_t selectTopK(const double* v, size_t n, size_t k, Id* out) {
+    TopK top(std::min(k, n));
+    for (size_t i = 0; i < n; ++i) {
+        // cheap reject before touching the heap; most rows of a long run end here
+        if (top.Full() && v[i] <= top.Worst().value) continue;
+        top.Offer((uint32_t)i, v[i]);
+    }
+    return top.Sorted(out);
+}
+
+// Statistics derived from EnergyDay::hourlyKWh. They are computed once when a
+// day is produced (computeEnergyStats) and kept current by updateHourlySample,
+// so the Draw* functions only read them.
+struct EnergyStats {
+    static const int kTopHours = 10;
+    double total = 0.0;
+    double avg = 0.0;        // total / 24
+    double min = 0.0;
+    int minHour = 0;
+    double peak = 0.0;       // first maximum
+    int peakHour = 0;
+    double nightAvg = 0.0;   // average of hours 00-05
+    int peakHours = 0;       // hours above 1.5x average, the "peak" rows of DrawTable
+    int topHours[kTopHours] = {}; // hours by descending kWh, ties by hour
+    int topCount = 0;
+    // alert flags shown by DrawChecklist
+    bool nightHigh = false;   // night load above 0.75x average
+    bool extremePeak = false; // peak above 2.0x average
+    bool complete = false;    // all 24 hours present
+};
+// One day of one building. The sample arrays are views, either over a
+// TimeSeriesStore slice or over a small owned buffer for simulated days.
+struct EnergyDay {
+    std::wstring_view buildingName;  // interned or a literal, see internName
+    SYSTEMTIME date;
+    SampleView hourlyKWh;         // 24 hourly buckets
+    SampleView samples;           // native meter resolution, samplesPerHour per hour
+    int samplesPerHour = 1;
+    uint32_t hourMask = 0xFFFFFF; // bit h set when hour h has data
+    std::vector<Consumer> topConsumers;
+    std::vector<Category> categoryBreakdown;
+    double priceCZKPerKWh;
+    EnergyStats stats;
+    uint64_t chartRevision = 0;   // new for every fillBreakdown, keys the chart geometry cache
+};
+
+// Rank the hours by descending consumption into stats.topHours
+void rankTopHours(EnergyDay& day) {
+    EnergyStats& s = day.stats;
+    s.topCount = (int)selectTopK(day.hourlyKWh.data(), std::min<size_t>(day.hourlyKWh.size(), 24), EnergyStats::kTopHours, s.topHours);
+}
+
+// Derive averages and alert flags from the totals already in stats
+void updateDerivedStats(EnergyDay& day) {
+    EnergyStats& s = day.stats;
+    s.avg = s.total / 24.0;
+    s.nightHigh = s.nightAvg > s.avg * 0.75;
+    s.extremePeak = s.peak > s.avg * 2.0;
+    s.peakHours = (int)aggCountAbove(day.hourlyKWh.data(), day.hourlyKWh.size(), s.avg * 1.5);
+    s.complete = day.hourlyKWh.size() == 24 && (day.hourMask & 0xFFFFFF) == 0xFFFFFF;
+}
+
+// Compute all statistics of a freshly produced day
+void computeEnergyStats(EnergyDay& day) {
+    EnergyStats& s = day.stats;
+    s = EnergyStats();
+    const SampleView& v = day.hourlyKWh;
+    s.total = aggSum(v.data(), v.size());
+    AggMinMax mm = aggMinMax(v.data(), v.size());
+    s.min = mm.min;
+    s.minHour = (int)mm.minIndex;
+    s.peak = std::max(mm.max, 0.0);
+    s.peakHour = mm.max > 0.0 ? (int)mm.maxIndex : 0;
+    s.nightAvg = aggSum(v.data(), std::min<size_t>(v.size(), 6)) / 6.0;
+    rankTopHours(day);
+    updateDerivedStats(day);
+}
+
+// Replace one hourly sample and update the statistics incrementally. hourly
+// is the caller's writable buffer behind day.hourlyKWh. Only a sample that
+// was the current minimum/maximum or that enters or leaves the top-hour
+// ranking causes a rescan of the 24 hours.
+void updateHourlySample(EnergyDay& day, const SampleBuffer& hourly, int hour, double kWh) {
+    if (hour < 0 || hour >= (int)day.hourlyKWh.size() || hourly.data() != day.hourlyKWh.data()) return;
+    EnergyStats& s = day.stats;
+    const SampleView& v = day.hourlyKWh;
+    double old = v[hour];
+    hourly[hour] = kWh;
+    s.total += kWh - old;
+    if (hour < 6) s.nightAvg += (kWh - old) / 6.0;
+    if (kWh > s.peak || (kWh == s.peak && hour < s.peakHour)) {
+        s.peak = kWh;
+        s.peakHour = hour;
+    } else if (hour == s.peakHour && kWh < old) {
+        AggMinMax mm = aggMinMax(v.data(), v.size());
+        s.peak = std::max(mm.max, 0.0);
+        s.peakHour = mm.max > 0.0 ? (int)mm.maxIndex : 0;
+    }
+    if (kWh < s.min || (kWh == s.min && hour < s.minHour)) {
+        s.min = kWh;
+        s.minHour = hour;
+    } else if (hour == s.minHour && kWh > old) {
+        AggMinMax mm = aggMinMax(v.data(), v.size());
+        s.min = mm.min;
+        s.minHour = (int)mm.minIndex;
+    }
+    bool ranked = std::find(s.topHours, s.topHours + s.topCount, hour) != s.topHours + s.topCount;
+    int last = s.topCount > 0 ? s.topHours[s.topCount - 1] : -1;
+    bool entersRanking = s.topCount < EnergyStats::kTopHours ||
+        (last >= 0 && (kWh > v[last] || (kWh == v[last] && hour < last)));
+    if (ranked && kWh < old) {
+        // a ranked hour went down: the next best hour may move up, rank again
+        rankTopHours(day);
+    } else if (ranked || entersRanking) {
+        // all other hours are unchanged, so the new ranking is drawn from the
+        // old one plus this hour
+        TopK top(EnergyStats::kTopHours);
+        for (int i = 0; i < s.topCount; ++i) {
+            if (s.topHours[i] != hour) top.Offer((uint32_t)s.topHours[i], v[s.topHours[i]]);
+        }
+        top.Offer((uint32_t)hour, kWh);
+        s.topCount = (int)top.Sorted(s.topHours);
+    }
+    updateDerivedStats(day);
+}
+
+void fillBreakdown(EnergyDay& day);
+
+// Simulate a day of energy usage with reproducible random variations
+EnergyDay simulateEnergyDay(uint64_t seed = 0xC0FFEEULL) {
+    ER_TRACE_SCOPE(TraceSimulate);
+    SeededRNG rng(seed);
+    EnergyDay day;
+    day.buildingName = L"Kancelářská budova A (menší)";
+    // current date
+    GetLocalTime(&day.date);
+    day.priceCZKPerKWh = 3.20;
+    SampleBuffer hourly = SampleBuffer::Allocate(24);
+    day.hourlyKWh = hourly;
+    day.samples = day.hourlyKWh;
+    for (int h = 0; h < 24; ++h) {
+        double baseNight = 6.5;
+        double baseWork = 16.0;
+        double baseEvening = 10.0;
+        double base;
+        if (h < 6 || h >= 23) base = baseNight;
+        else if (h < 8) base = baseNight + 3.0;
+        else if (h <= 18) base = baseWork;
+        else base = baseEvening;
+        double wave = (h >= 8 && h <= 18) ? (7.0 * std::sin((h - 8.0) / 10.0 * 3.14159265358979323846)) : 0.0;
+        double noise = (rng.nextDouble01() - 0.5) * 2.0;
+        double spike = (rng.nextDouble01() < 0.08) ? (5.0 + rng.nextDouble01() * 10.0) : 0.0;
+        double kWh = std::max(3.0, base + wave + noise + spike);
+        hourly[h] = kWh;
+    }
+    computeEnergyStats(day);
+    fillBreakdown(day);
+    return day;
+}
+
+// Fixed shares of the day's total; each table must add up to the whole day
+struct ShareSpec {
+    const wchar_t* name;
+    double share;
+};
+
+constexpr ShareSpec kCategoryShares[] = {
+    {L"HVAC (chlazení + VZT)", 0.42},
+    {L"Osvětlení", 0.22},
+    {L"IT + serverovna", 0.18},
+    {L"Zásuvky / kuchyňky", 0.10},
+    {L"Ostatní", 0.08}
+};
+
+constexpr ShareSpec kConsumerShares[] = {
+    {L"Chiller / tepelné čerpadlo", 0.22},
+    {L"VZT jednotky", 0.17},
+    {L"Osvětlení open-space", 0.15},
+    {L"Serverovna UPS", 0.14},
+    {L"EV nabíjení", 0.10},
+    {L"Výtahy", 0.05},
+    {L"Ostatní", 0.17}
+};
+
+template <size_t N>
+constexpr bool sharesAddUp(const ShareSpec (&shares)[N]) {
+    double sum = 0.0;
+    for (size_t i = 0; i < N; ++i) sum += shares[i].share;
+    return sum > 0.999999 && sum < 1.000001;
+}
+static_assert(sharesAddUp(kCategoryShares), "category shares must add up to 1");
+static_assert(sharesAddUp(kConsumerShares), "consumer shares must add up to 1");
+
+// Source of EnergyDay::chartRevision
+static std::atomic<uint64_t> g_chartRevision{ 0 };
+
+// Split the day's total into categories and top consumers by fixed shares
+void fillBreakdown(EnergyDay& day) {
+    day.chartRevision = g_chartRevision.fetch_add(1, std::memory_order_relaxed) + 1;
+    // total consumption
+    double total = day.stats.total;
+    // categories (shares)
+    day.categoryBreakdown.clear();
+    for (auto& c : kCategoryShares) {
+        Category cat;
+        cat.name = c.name;
+        cat.kWh = total * c.share;
+        day.categoryBreakdown.push_back(cat);
+    }
+    // top consumers
+    std::vector<Consumer> list;
+    for (auto& cr : kConsumerShares) {
+        Consumer cons;
+        cons.name = cr.name;
+        cons.kWh = total * cr.share;
+        list.push_back(cons);
+    }
+    // top 6 by descending consumption, equal shares in table order
+    TopK top(6);
+    for (size_t i = 0; i < list.size(); ++i) top.Offer((uint32_t)i, list[i].kWh);
+    uint32_t order[6];
+    size_t count = top.Sorted(order);
+    day.topConsumers.clear();
+    for (size_t i = 0; i < count; ++i) day.topConsumers.push_back(list[order[i]]);
+}
+
+// ---- Label formatting ----
+// Fixed-capacity wide string on the stack for chart labels. Numbers are
+// written with std::to_chars, so building a label never allocates and the
+// renderer gets a pointer and a length; text beyond the capacity is cut off.
+class Label {
+public:
+    static const size_t kCapacity = 120;
+
+    Label() {}
+    explicit Label(const wchar_t* text) { Add(text); }
+
+    Label& Add(const wchar_t* text) {
+        while (*text && len < kCapacity) buf[len++] = *text++;
+        return *this;
+    }
+    Label& Add(const wchar_t* text, size_t n) {
+        n = std::min(n, kCapacity - len);
+        std::copy(text, text + n, buf + len);
+        len += n;
+        return *this;
+    }
+    Label& Add(std::wstring_view text) { return Add(text.data(), text.size()); }
+    Label& Add(wchar_t c) {
+        if (len < kCapacity) buf[len++] = c;
+        return *this;
+    }
+    // decimals digits after the point, as std::fixed << std::setprecision
+    Label& Fixed(double v, int decimals) {
+        char digits[352];
+        std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), v, std::chars_format::fixed, decimals);
+        if (res.ec != std::errc()) return Add(L'?');
+        return AddAscii(digits, res.ptr);
+    }
+    // integer, zero-padded to at least width digits
+    Label& Int(long long v, int width = 1) {
+        char digits[24];
+        std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), v);
+        const char* from = digits;
+        if (*from == '-') {
+            Add(L'-');
+            ++from;
+        }
+        for (int pad = width - (int)(res.ptr - from); pad > 0; --pad) Add(L'0');
+        return AddAscii(from, res.ptr);
+    }
+    // HH:00
+    Label& Hour(int hour) { return Int(hour, 2).Add(L":00"); }
+    // dd.mm.yyyy
+    Label& Date(const SYSTEMTIME& st) { return Int(st.wDay, 2).Add(L'.').Int(st.wMonth, 2).Add(L'.').Int(st.wYear); }
+
+    const wchar_t* data() const { return buf; }
+    size_t size() const { return len; }
+    std::wstring str() const { return std::wstring(buf, len); }
+
+private:
+    Label& AddAscii(const char* from, const char* to) {
+        while (from < to && len < kCapacity) buf[len++] = (wchar_t)*from++;
+        return *this;
+    }
+
+    wchar_t buf[kCapacity];
+    size_t len = 0;
+};
+
+// Helper to format date as dd.mm.yyyy
+std::wstring formatDate(const SYSTEMTIME& st) {
+    return Label().Date(st).str();
+}
+
+// ---- Columnar time-series store ----
+// Day numbers count days since 1970-01-01 (proleptic Gregorian calendar).
+int64_t daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+SYSTEMTIME civilFromDays(int64_t days) {
+    const int64_t z = days + 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = (unsigned)(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    SYSTEMTIME st = {};
+    st.wYear = (WORD)((int64_t)yoe + era * 400 + (m <= 2));
+    st.wMonth = (WORD)m;
+    st.wDay = (WORD)d;
+    st.wDayOfWeek = (WORD)(((days % 7) + 11) % 7); // 1970-01-01 was a Thursday
+    return st;
+}
+
+// True when count elements of elemSize bytes starting at offset lie within
+// size bytes. Never overflows, whatever a corrupt header holds.
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t elemSize, uint64_t size) {
+    return offset <= size && count <= (size - offset) / elemSize;
+}
+
+// Whole-file memory mapping (or pagefile-backed memory when the path is
+// empty). It is shared by the store and by every SampleView into it, so day
+// views stay valid even after the store itself is closed.
+struct MappedFile {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    uint8_t* base = nullptr;
+    uint64_t size = 0;
+    ~MappedFile() {
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+    static std::shared_ptr<MappedFile> Open(const std::wstring& path, bool writable) {
+        std::shared_ptr<MappedFile> m = std::make_shared<MappedFile>();
+        m->file = CreateFileW(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m->file == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0) return nullptr;
+        m->size = (uint64_t)size.QuadPart;
+        return m->Map(writable) ? m : nullptr;
+    }
+    // New zero-filled mapping of the given size. Without replace, an existing
+    // file is left alone and Create fails.
+    static std::shared_ptr<MappedFile> Create(const std::wstring& path, uint64_t size, bool replace = true) {
+        std::shared_ptr<MappedFile> m = std::make_shared<MappedFile>();
+        m->size = size;
+        if (!path.empty()) {
+            m->file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                NULL, replace ? CREATE_ALWAYS : CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (m->file == INVALID_HANDLE_VALUE) return nullptr;
+        }
+        return m->Map(true) ? m : nullptr;
+    }
+private:
+    bool Map(bool writable) {
+        mapping = CreateFileMappingW(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+            (DWORD)(size >> 32), (DWORD)size, NULL);
+        if (!mapping) return false;
+        base = (uint8_t*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)size);
+        return base != nullptr;
+    }
+};
+
+// Fixed-layout header at offset 0 of a store file
+struct StoreHeader {
+    char magic[8];             // "ERTSTORE"
+    uint32_t version;
+    uint32_t buildingCount;
+    uint32_t dayCount;
+    uint32_t samplesPerDay;    // multiple of 24: 24 (hourly), 96 (15 min), 1440 (1 min)
+    int64_t firstDay;          // day number of day index 0
+    uint64_t buildingsOffset;  // StoreBuilding table
+    uint64_t dataOffset;       // first building block
+    uint64_t buildingStride;   // bytes per building block
+};
+
+struct StoreBuilding {
+    char name[120];            // UTF-8, NUL terminated
+    double priceCZKPerKWh;
+};
+
+// Memory-mapped store of kWh samples for many buildings and days. Every
+// building owns one contiguous block holding its columns one after another
+// (structure of arrays):
+//   samples  double[dayCount * samplesPerDay]  native meter resolution
+//   hourly   double[dayCount * 24]             hourly buckets
+//   masks    uint32_t[dayCount]                bit h set when hour h has data
+// Day(b, d) returns an EnergyDay whose sample arrays point straight into the
+// mapping, so the Draw* functions render any day without copying samples.
+class TimeSeriesStore {
+public:
+    static const uint32_t kVersion = 1;
+
+    bool Create(const std::wstring& path, uint32_t buildings, uint32_t days, uint32_t samplesPerDay, int64_t firstDay,
+        bool replace = true) {
+        Close();
+        if (buildings == 0 || days == 0 || samplesPerDay == 0 || samplesPerDay % 24 != 0) return false;
+        uint64_t table = Align((uint64_t)sizeof(StoreHeader));
+        uint64_t data = Align(table + (uint64_t)buildings * sizeof(StoreBuilding));
+        uint64_t stride = Align((uint64_t)days * samplesPerDay * sizeof(double) +
+            (uint64_t)days * 24 * sizeof(double) + (uint64_t)days * sizeof(uint32_t));
+        file = MappedFile::Create(path, data + stride * buildings, replace);
+        if (!file) return false;
+        header = (StoreHeader*)file->base;
+        memcpy(header->magic, "ERTSTORE", 8);
+        header->version = kVersion;
+        header->buildingCount = buildings;
+        header->dayCount = days;
+        header->samplesPerDay = samplesPerDay;
+        header->firstDay = firstDay;
+        header->buildingsOffset = table;
+        header->dataOffset = data;
+        header->buildingStride = stride;
+        return true;
+    }
+
+    bool Open(const std::wstring& path, bool writable) {
+        Close();
+        file = MappedFile::Open(path, writable);
+        if (!file || file->size < sizeof(StoreHeader)) return Fail();
+        header = (StoreHeader*)file->base;
+        const StoreHeader& h = *header;
+        if (memcmp(h.magic, "ERTSTORE", 8) != 0 || h.version != kVersion) return Fail();
+        if (h.samplesPerDay == 0 || h.samplesPerDay % 24 != 0 || h.buildingCount == 0 || h.dayCount == 0) return Fail();
+        // 32-bit counts: need cannot overflow, the offsets are checked without adding
+        uint64_t need = (uint64_t)h.dayCount * ((uint64_t)h.samplesPerDay + 24) * sizeof(double) + (uint64_t)h.dayCount * sizeof(uint32_t);
+        if (h.buildingStride < need || h.buildingStride % alignof(double) != 0 || h.dataOffset % alignof(double) != 0 ||
+            h.buildingsOffset < sizeof(StoreHeader) || h.buildingsOffset % alignof(StoreBuilding) != 0 ||
+            !rangeFits(h.buildingsOffset, h.buildingCount, sizeof(StoreBuilding), h.dataOffset) ||
+            !rangeFits(h.dataOffset, h.buildingCount, h.buildingStride, file->size)) return Fail();
+        return true;
+    }
+
+    void Close() {
+        header = nullptr;
+        file.reset();
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    uint32_t BuildingCount() const { return header ? header->buildingCount : 0; }
+    uint32_t DayCount() const { return header ? header->dayCount : 0; }
+    uint32_t SamplesPerDay() const { return header ? header->samplesPerDay : 0; }
+    int64_t FirstDay() const { return header ? header->firstDay : 0; }
+
+    void SetBuilding(uint32_t b, const std::string& name, double priceCZKPerKWh) {
+        StoreBuilding& sb = Building(b);
+        memset(sb.name, 0, sizeof(sb.name));
+        // names are UTF-8: never cut a multi-byte sequence in half
+        size_t n = std::min(name.size(), sizeof(sb.name) - 1);
+        if (n < name.size()) while (n > 0 && ((uint8_t)name[n] & 0xC0) == 0x80) --n;
+        memcpy(sb.name, name.data(), n);
+        sb.priceCZKPerKWh = priceCZKPerKWh;
+    }
+    // bounded by the field: a store file need not NUL-terminate its names
+    std::string BuildingName(uint32_t b) const {
+        const StoreBuilding& sb = Building(b);
+        return std::string(sb.name, strnlen(sb.name, sizeof(sb.name)));
+    }
+
+    double* Samples(uint32_t b, uint32_t d) const {
+        return (double*)Block(b) + (uint64_t)d * header->samplesPerDay;
+    }
+    double* Hourly(uint32_t b, uint32_t d) const {
+        return (double*)Block(b) + (uint64_t)header->dayCount * header->samplesPerDay + (uint64_t)d * 24;
+    }
+    uint32_t* HourMasks(uint32_t b) const {
+        return (uint32_t*)((double*)Block(b) + (uint64_t)header->dayCount * (header->samplesPerDay + 24));
+    }
+
+    // Rebuild the hourly buckets of one day from its native samples
+    void RollupHourly(uint32_t b, uint32_t d) {
+        const double* src = Samples(b, d);
+        double* dst = Hourly(b, d);
+        aggResample(src, 24, header->samplesPerDay / 24, dst);
+    }
+
+    // Zero-copy view of one building/day with its statistics computed
+    EnergyDay Day(uint32_t b, uint32_t d) const {
+        EnergyDay day;
+        day.buildingName = internName(BuildingName(b));
+        day.date = civilFromDays(header->firstDay + d);
+        day.priceCZKPerKWh = Building(b).priceCZKPerKWh;
+        day.hourlyKWh = SampleView(file, Hourly(b, d), 24);
+        day.samples = SampleView(file, Samples(b, d), header->samplesPerDay);
+        day.samplesPerHour = (int)(header->samplesPerDay / 24);
+        day.hourMask = HourMasks(b)[d];
+        computeEnergyStats(day);
+        fillBreakdown(day);
+        return day;
+    }
+
+private:
+    static uint64_t Align(uint64_t v) { return (v + 63) & ~(uint64_t)63; }
+    bool Fail() {
+        Close();
+        return false;
+    }
+    StoreBuilding& Building(uint32_t b) const {
+        return ((StoreBuilding*)(file->base + header->buildingsOffset))[b];
+    }
+    uint8_t* Block(uint32_t b) const {
+        return file->base + header->dataOffset + header->buildingStride * b;
+    }
+
+    std::shared_ptr<MappedFile> file;
+    StoreHeader* header = nullptr;
+};
+
+// ---- Report snapshots ----
+// A snapshot holds finished report days, one fixed-size record each, so a
+// launch can show them without importing or simulating anything. Opening
+// maps the file and checks the offsets; a day record is used in place. The
+// hourly buckets are viewed straight from the mapping, the statistics are
+// copied from the stored EnergyStats, and the building name is a UTF-16
+// view into the name pool. Only native-resolution samples are stored
+// compactly, as float32 residuals from the mean sample of their hour.
+// Decoding a day turns them back into doubles: one add per sample,
+// exact to float precision of the residual.
+struct SnapshotHeader {
+    char magic[8];             // "ERSNAPSH"
+    uint32_t version;
+    uint32_t dayRecordSize;    // sizeof(SnapshotDay) of the writer: layout check
+    uint32_t dayCount;
+    uint32_t nameChars;        // UTF-16 code units in the name pool
+    uint64_t daysOffset;       // SnapshotDay[dayCount]
+    uint64_t namesOffset;      // names, NUL separated
+    uint64_t samplesOffset;    // float residuals of all days
+    uint64_t sampleCount;
+};
+
+struct SnapshotDay {
+    double hourlyKWh[24];
+    EnergyStats stats;
+    double priceCZKPerKWh;
+    int64_t date;              // day number, see daysFromCivil
+    uint64_t firstSample;      // index into the residuals
+    uint32_t sampleCount;      // 24 * samplesPerHour, 0: samples are the hourly buckets
+    uint32_t hourMask;
+    uint32_t nameOffset;       // into the name pool
+    uint32_t nameLength;
+};
+static_assert(std::is_trivially_copyable<EnergyStats>::value, "EnergyStats is stored verbatim in snapshots");
+static_assert(sizeof(wchar_t) == 2, "snapshot names are UTF-16");
+
+class ReportSnapshot {
+public:
+    static const uint32_t kVersion = 1;
+
+    static bool Write(const std::wstring& path, const std::vector<const EnergyDay*>& days) {
+        if (days.empty()) return false;
+        // names are pooled: a year of one building stores its name once
+        std::wstring names;
+        std::unordered_map<std::wstring_view, uint32_t> pooled; // views of the days' own names
+        std::vector<uint32_t> nameAt(days.size());
+        uint64_t samples = 0;
+        for (size_t i = 0; i < days.size(); ++i) {
+            std::wstring_view name = days[i]->buildingName;
+            auto it = pooled.emplace(name, (uint32_t)names.size());
+            if (it.second) {
+                names.append(name);
+                names.push_back(L'\0');
+            }
+            nameAt[i] = it.first->second;
+            samples += StoredSamples(*days[i]);
+        }
+        uint64_t daysAt = Align(sizeof(SnapshotHeader));
+        uint64_t namesAt = Align(daysAt + days.size() * sizeof(SnapshotDay));
+        uint64_t samplesAt = Align(namesAt + names.size() * sizeof(wchar_t));
+        std::shared_ptr<MappedFile> file = MappedFile::Create(path, samplesAt + samples * sizeof(float));
+        if (!file) return false;
+        SnapshotHeader& h = *(SnapshotHeader*)file->base;
+        memcpy(h.magic, "ERSNAPSH", 8);
+        h.version = kVersion;
+        h.dayRecordSize = sizeof(SnapshotDay);
+        h.dayCount = (uint32_t)days.size();
+        h.nameChars = (uint32_t)names.size();
+        h.daysOffset = daysAt;
+        h.namesOffset = namesAt;
+        h.samplesOffset = samplesAt;
+        h.sampleCount = samples;
+        memcpy(file->base + namesAt, names.data(), names.size() * sizeof(wchar_t));
+        SnapshotDay* records = (SnapshotDay*)(file->base + daysAt);
+        float* residuals = (float*)(file->base + samplesAt);
+        uint64_t next = 0;
+        for (size_t i = 0; i < days.size(); ++i) {
+            const EnergyDay& day = *days[i];
+            SnapshotDay& r = records[i];
+            for (size_t k = 0; k < 24; ++k) r.hourlyKWh[k] = k < day.hourlyKWh.size() ? day.hourlyKWh[k] : 0.0;
+            r.stats = day.stats;
+            r.priceCZKPerKWh = day.priceCZKPerKWh;
+            r.date = daysFromCivil(day.date.wYear, day.date.wMonth, day.date.wDay);
+            r.firstSample = next;
+            r.sampleCount = (uint32_t)StoredSamples(day);
+            r.hourMask = day.hourMask;
+            r.nameOffset = nameAt[i];
+            r.nameLength = (uint32_t)day.buildingName.size();
+            const size_t perHour = (size_t)day.samplesPerHour;
+            for (size_t k = 0; k < r.sampleCount; ++k) {
+                residuals[next + k] = (float)(day.samples[k] - r.hourlyKWh[k / perHour] / perHour);
+            }
+            next += r.sampleCount;
+        }
+        return true;
+    }
+
+    bool Open(const std::wstring& path) {
+        Close();
+        file = MappedFile::Open(path, false);
+        if (!file || file->size < sizeof(SnapshotHeader)) return Fail();
+        header = (const SnapshotHeader*)file->base;
+        const SnapshotHeader& h = *header;
+        if (memcmp(h.magic, "ERSNAPSH", 8) != 0 || h.version != kVersion || h.dayRecordSize != sizeof(SnapshotDay) || h.dayCount == 0) return Fail();
+        // each table must lie inside the file and be aligned for its type
+        if (h.daysOffset < sizeof(SnapshotHeader) || h.daysOffset % alignof(SnapshotDay) != 0 ||
+            !rangeFits(h.daysOffset, h.dayCount, sizeof(SnapshotDay), file->size) ||
+            h.namesOffset % alignof(wchar_t) != 0 || !rangeFits(h.namesOffset, h.nameChars, sizeof(wchar_t), file->size) ||
+            h.samplesOffset % alignof(float) != 0 || !rangeFits(h.samplesOffset, h.sampleCount, sizeof(float), file->size)) return Fail();
+        // every record must stay inside the pools; nothing else is checked later
+        for (uint32_t d = 0; d < h.dayCount; ++d) {
+            const SnapshotDay& r = Record(d);
+            if (!rangeFits(r.nameOffset, r.nameLength, 1, h.nameChars) || !rangeFits(r.firstSample, r.sampleCount, 1, h.sampleCount) ||
+                r.sampleCount % 24 != 0 || !StatsValid(r.stats)) return Fail();
+        }
+        return true;
+    }
+
+    void Close() {
+        header = nullptr;
+        file.reset();
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    uint32_t DayCount() const { return header ? header->dayCount : 0; }
+
+    // Day d, ready to draw. The hourly buckets are read-only views into the
+    // mapping and the name points into it, so the snapshot stays open while
+    // its days are shown.
+    EnergyDay Day(uint32_t d) const {
+        const SnapshotDay& r = Record(d);
+        EnergyDay day;
+        day.buildingName = std::wstring_view((const wchar_t*)(file->base + header->namesOffset) + r.nameOffset, r.nameLength);
+        day.date = civilFromDays(r.date);
+        day.priceCZKPerKWh = r.priceCZKPerKWh;
+        day.hourlyKWh = SampleView(file, r.hourlyKWh, 24);
+        day.hourMask = r.hourMask;
+        day.stats = r.stats;
+        if (r.sampleCount == 0) {
+            day.samples = day.hourlyKWh;
+        } else {
+            const size_t perHour = r.sampleCount / 24;
+            const float* residuals = (const float*)(file->base + header->samplesOffset) + r.firstSample;
+            SampleBuffer samples = SampleBuffer::Allocate(r.sampleCount);
+            for (size_t k = 0; k < r.sampleCount; ++k) samples[k] = r.hourlyKWh[k / perHour] / perHour + residuals[k];
+            day.samples = samples;
+            day.samplesPerHour = (int)perHour;
+        }
+        fillBreakdown(day);
+        return day;
+    }
+
+private:
+    static uint64_t Align(uint64_t v) { return (v + 63) & ~(uint64_t)63; }
+    // the stored hours index hourlyKWh and the ranking is read up to topCount
+    static bool StatsValid(const EnergyStats& s) {
+        auto hour = [](int h) { return h >= 0 && h < 24; };
+        if (s.topCount < 0 || s.topCount > EnergyStats::kTopHours || !hour(s.peakHour) || !hour(s.minHour) ||
+            s.peakHours < 0 || s.peakHours > 24) return false;
+        for (int i = 0; i < s.topCount; ++i) if (!hour(s.topHours[i])) return false;
+        return true;
+    }
+    // native samples worth storing: not when they are the hourly buckets
+    static size_t StoredSamples(const EnergyDay& day) {
+        bool native = day.samplesPerHour > 1 && day.samples.data() != day.hourlyKWh.data() &&
+            day.samples.size() == (size_t)day.samplesPerHour * 24 && day.hourlyKWh.size() == 24;
+        return native ? day.samples.size() : 0;
+    }
+    bool Fail() {
+        Close();
+        return false;
+    }
+    const SnapshotDay& Record(uint32_t d) const {
+        return ((const SnapshotDay*)(file->base + header->daysOffset))[d];
+    }
+
+    std::shared_ptr<MappedFile> file;
+    const SnapshotHeader* header = nullptr;
+};
+
+// ---- Streaming meter CSV importer ----
+// Smart-meter exports are "timestamp<sep>kWh" rows, one meter per file, with
+// ',' ';' or tab as separator (',' is also accepted as decimal mark when it is
+// not the separator). Timestamps are "YYYY-MM-DD[T ]HH:MM[:SS]" or
+// "DD.MM.YYYY HH:MM[:SS]" and mark the start of the metering interval.
+// Header and malformed rows are counted and skipped. The whole file is
+// mapped and parsed in place, without per-line allocations.
+struct ImportStats {
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint64_t samples = 0;   // rows aggregated into the store
+    uint64_t rejected = 0;  // header rows, malformed rows, rows outside the store range
+    uint64_t outOfRange = 0; // of rejected: valid rows dated outside the store range
+    double seconds = 0.0;
+    double MBps() const { return seconds > 0.0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+};
+
+// Parse exactly 'digits' decimal digits (or 1..digits when 'variable')
+bool parseDigits(const char*& p, const char* end, int digits, bool variable, int& out) {
+    int v = 0;
+    int n = 0;
+    while (n < digits && p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        ++n;
+    }
+    out = v;
+    return variable ? n > 0 : n == digits;
+}
+
+// Parse a timestamp into a day number and minute of day
+bool parseMeterTimestamp(const char* p, const char* end, int64_t& day, int& minute) {
+    int y, mo, d, h, mi;
+    if (end - p >= 10 && p[4] == '-') {
+        if (!parseDigits(p, end, 4, false, y) || *p++ != '-' ||
+            !parseDigits(p, end, 2, false, mo) || *p++ != '-' ||
+            !parseDigits(p, end, 2, false, d)) return false;
+    } else {
+        if (!parseDigits(p, end, 2, true, d) || p >= end || *p++ != '.' ||
+            !parseDigits(p, end, 2, true, mo) || p >= end || *p++ != '.' ||
+            !parseDigits(p, end, 4, false, y)) return false;
+    }
+    if (p >= end || (*p != 'T' && *p != ' ')) return false;
+    ++p;
+    if (!parseDigits(p, end, 2, true, h) || p >= end || *p++ != ':' || !parseDigits(p, end, 2, false, mi)) return false;
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59) return false;
+    day = daysFromCivil(y, (unsigned)mo, (unsigned)d);
+    minute = h * 60 + mi;
+    return true;
+}
+
+// Parse a decimal number with '.' or ',' as decimal mark
+bool parseMeterValue(const char* p, const char* end, double& out) {
+    char buf[64];
+    size_t n = (size_t)(end - p);
+    if (n == 0 || n >= sizeof(buf)) return false;
+    for (size_t i = 0; i < n; ++i) buf[i] = p[i] == ',' ? '.' : p[i];
+    std::from_chars_result r = std::from_chars(buf, buf + n, out);
+    return r.ec == std::errc() && r.ptr == buf + n;
+}
+
+// Cursor over the rows of a mapped CSV file
+class MeterCsvReader {
+public:
+    MeterCsvReader(const uint8_t* data, uint64_t size)
+        : p((const char*)data), end((const char*)data + size) {
+        if (end - p >= 3 && (uint8_t)p[0] == 0xEF && (uint8_t)p[1] == 0xBB && (uint8_t)p[2] == 0xBF) p += 3;
+    }
+    // Advance to the next non-empty line; false at end of file
+    bool NextLine() {
+        while (p < end) {
+            const char* eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (!eol) eol = end;
+            lineBegin = p;
+            lineEnd = eol;
+            p = eol < end ? eol + 1 : end;
+            if (lineEnd > lineBegin && lineEnd[-1] == '\r') --lineEnd;
+            if (lineEnd > lineBegin) return true;
+        }
+        return false;
+    }
+    // Parse the current line as timestamp + value
+    bool ParseRow(int64_t& day, int& minute, double& kWh) {
+        if (!sep) DetectSeparator();
+        const char* a = lineBegin;
+        const char* sepPos = (const char*)memchr(a, sep, (size_t)(lineEnd - a));
+        if (!sepPos) return false;
+        const char* b = sepPos + 1;
+        const char* bEnd = (const char*)memchr(b, sep, (size_t)(lineEnd - b));
+        if (!bEnd) bEnd = lineEnd;
+        const char* aEnd = sepPos;
+        Trim(a, aEnd);
+        Trim(b, bEnd);
+        return parseMeterTimestamp(a, aEnd, day, minute) && parseMeterValue(b, bEnd, kWh);
+    }
+private:
+    void DetectSeparator() {
+        sep = ',';
+        for (const char* q = lineBegin; q < lineEnd; ++q) {
+            if (*q == ';' || *q == '\t') {
+                sep = *q;
+                break;
+            }
+        }
+    }
+    static void Trim(const char*& a, const char*& b) {
+        while (a < b && (*a == ' ' || *a == '"')) ++a;
+        while (b > a && (b[-1] == ' ' || b[-1] == '"')) --b;
+    }
+    const char* p;
+    const char* end;
+    const char* lineBegin = nullptr;
+    const char* lineEnd = nullptr;
+    char sep = 0;
+};
+
+double secondsSince(const LARGE_INTEGER& start) {
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double)(now.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+}
+
+// Aggregate a meter CSV into building b of an existing store. Each row is
+// added to the sample slot containing its timestamp, so finer data is summed
+// into a coarser store resolution; touched days get their hourly buckets
+// rebuilt at the end.
+bool ImportMeterCsv(const std::wstring& path, TimeSeriesStore& store, uint32_t b, ImportStats& stats) {
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    stats = ImportStats();
+    std::shared_ptr<MappedFile> file = MappedFile::Open(path, false);
+    if (!file || !store.IsOpen() || b >= store.BuildingCount()) return false;
+    stats.bytes = file->size;
+    const uint32_t days = store.DayCount();
+    const uint32_t perDay = store.SamplesPerDay();
+    const int64_t firstDay = store.FirstDay();
+    uint32_t* masks = store.HourMasks(b);
+    std::vector<uint8_t> touched(days, 0);
+    MeterCsvReader reader(file->base, file->size);
+    while (reader.NextLine()) {
+        ++stats.lines;
+        int64_t day;
+        int minute;
+        double kWh;
+        if (!reader.ParseRow(day, minute, kWh)) {
+            ++stats.rejected;
+            continue;
+        }
+        if (day < firstDay || day >= firstDay + days) {
+            ++stats.rejected;
+            ++stats.outOfRange;
+            continue;
+        }
+        uint32_t d = (uint32_t)(day - firstDay);
+        store.Samples(b, d)[(uint32_t)minute * perDay / 1440] += kWh;
+        masks[d] |= 1u << (minute / 60);
+        touched[d] = 1;
+        ++stats.samples;
+    }
+    for (uint32_t d = 0; d < days; ++d) if (touched[d]) store.RollupHourly(b, d);
+    stats.seconds = secondsSince(start);
+    return stats.samples > 0;
+}
+
+// Longest date range one CSV import covers (ten years)
+static const int64_t kMaxImportDays = 3660;
+
+// Create a store sized for one meter CSV and import it. A first pass counts
+// the rows of every day; the store covers the window of at most
+// kMaxImportDays days holding the most rows, so neither a stray timestamp
+// nor an unsorted file sizes it for decades or pushes the real data out.
+// Rows outside it are counted in stats.outOfRange. The resolution comes from
+// the first interval (kept when it divides an hour, hourly otherwise). An
+// empty storePath keeps the store in memory; an existing file there is never
+// overwritten, the import fails instead.
+bool ImportMeterCsvToStore(const std::wstring& csvPath, const std::wstring& storePath,
+    const std::string& buildingName, TimeSeriesStore& store, ImportStats& stats) {
+    std::shared_ptr<MappedFile> file = MappedFile::Open(csvPath, false);
+    if (!file) return false;
+    int64_t firstDay = 0, lastDay = 0, day;
+    int firstMinute = -1, minute, interval = 60;
+    double kWh;
+    int found = 0;
+    MeterCsvReader head(file->base, file->size);
+    while (found < 2 && head.NextLine()) {
+        if (!head.ParseRow(day, minute, kWh)) continue;
+        if (found == 0) {
+            firstDay = lastDay = day;
+            firstMinute = minute;
+        } else {
+            int64_t delta = (day - firstDay) * 1440 + minute - firstMinute;
+            if (delta > 0 && delta <= 60 && 60 % delta == 0) interval = (int)delta;
+        }
+        ++found;
+    }
+    if (found == 0) return false;
+    // rows per day; meter exports are mostly sorted, so runs of one day skip the map
+    std::unordered_map<int64_t, uint64_t> counts;
+    int64_t runDay = 0;
+    uint64_t run = 0;
+    MeterCsvReader scan(file->base, file->size);
+    while (scan.NextLine()) {
+        if (!scan.ParseRow(day, minute, kWh)) continue;
+        if (run && day != runDay) {
+            counts[runDay] += run;
+            run = 0;
+        }
+        runDay = day;
+        ++run;
+    }
+    if (run) counts[runDay] += run;
+    std::vector<std::pair<int64_t, uint64_t>> perDay(counts.begin(), counts.end());
+    std::sort(perDay.begin(), perDay.end());
+    // sliding window over the sorted days
+    size_t bestBegin = 0, bestEnd = 0;
+    uint64_t best = 0, inWindow = 0;
+    for (size_t lo = 0, hi = 0; hi < perDay.size(); ++hi) {
+        inWindow += perDay[hi].second;
+        while (perDay[hi].first - perDay[lo].first >= kMaxImportDays) inWindow -= perDay[lo++].second;
+        if (inWindow > best) {
+            best = inWindow;
+            bestBegin = lo;
+            bestEnd = hi;
+        }
+    }
+    firstDay = perDay[bestBegin].first;
+    lastDay = perDay[bestEnd].first;
+    file.reset();
+    uint32_t days = (uint32_t)(lastDay - firstDay + 1);
+    if (!store.Create(storePath, 1, days, (uint32_t)(1440 / interval), firstDay, false)) return false;
+    store.SetBuilding(0, buildingName, 3.20);
+    return ImportMeterCsv(csvPath, store, 0, stats);
+}
+
+// ---- Synthetic load generator ----
+// The base/wave/noise/spike model of simulateEnergyDay at any store
+// resolution, drawn from CounterRNG streams keyed by seed, building and day
+// number. Every sample depends only on those and its index, so --generate
+// fills years of minute data for thousands of buildings on all cores and
+// writes the same file whatever the thread count. Samples are kWh per
+// interval; the hourly rollup has the scale of simulateEnergyDay.
+class LoadModel {
+public:
+    LoadModel(uint64_t seed, uint32_t samplesPerDay) : seed(seed), samplesPerDay(samplesPerDay), shape(samplesPerDay) {
+        const uint32_t perHour = samplesPerDay / 24;
+        for (uint32_t i = 0; i < samplesPerDay; ++i) {
+            int h = (int)(i / perHour);
+            double base;
+            if (h < 6 || h >= 23) base = 6.5;
+            else if (h < 8) base = 6.5 + 3.0;
+            else if (h <= 18) base = 16.0;
+            else base = 10.0;
+            double wave = (h >= 8 && h <= 18) ? (7.0 * std::sin((h - 8.0) / 10.0 * 3.14159265358979323846)) : 0.0;
+            shape[i] = base + wave;
+        }
+    }
+
+    uint32_t SamplesPerDay() const { return samplesPerDay; }
+
+    // Buildings differ in size by a factor 0.6 .. 1.6
+    double Scale(uint32_t building) const {
+        return 0.6 + CounterRNG(CounterRNG::Key(seed, building, INT64_MIN)).Double01At(0);
+    }
+
+    // Samples of one building on day number day (see daysFromCivil)
+    void Day(uint32_t building, int64_t day, double* out) const;
+
+private:
+    uint64_t seed;
+    uint32_t samplesPerDay;
+    std::vector<double> shape;  // base + wave per sample
+};
+
+// Sample i uses draws 3i (noise), 3i + 1 (spike chance), 3i + 2 (spike size)
+void simulateLoadScalar(const double* shape, size_t n, uint64_t key, double factor, double* out) {
+    const CounterRNG rng(key);
+    for (size_t i = 0; i < n; ++i) {
+        double noise = (rng.Double01At(3 * i) - 0.5) * 2.0;
+        double chance = rng.Double01At(3 * i + 1);
+        double spike = chance < 0.08 ? (5.0 + rng.Double01At(3 * i + 2) * 10.0) : 0.0;
+        out[i] = std::max(3.0, shape[i] + noise + spike) * factor;
+    }
+}
+
+#if defined(ER_HAVE_X86_SIMD)
+// 64-bit lane multiply by a constant from three 32x32 products
+ER_TARGET_AVX2 inline __m256i loadMul64Avx2(__m256i a, uint64_t b) {
+    const __m256i lo = _mm256_set1_epi64x((long long)(b & 0xFFFFFFFFu));
+    const __m256i hi = _mm256_set1_epi64x((long long)(b >> 32));
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), lo), _mm256_mul_epu32(a, hi));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, lo), _mm256_slli_epi64(cross, 32));
+}
+
+ER_TARGET_AVX2 inline __m256d loadUnitAvx2(__m256i z) {
+    z = loadMul64Avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), 0xBF58476D1CE4E5B9ULL);
+    z = loadMul64Avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), 0x94D049BB133111EBULL);
+    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+    __m256i one = _mm256_or_si256(_mm256_srli_epi64(z, 12), _mm256_set1_epi64x(0x3FF0000000000000LL));
+    return _mm256_sub_pd(_mm256_castsi256_pd(one), _mm256_set1_pd(1.0));
+}
+
+// Four samples per step; bit-identical to simulateLoadScalar
+ER_TARGET_AVX2 void simulateLoadAvx2(const double* shape, size_t n, uint64_t key, double factor, double* out) {
+    const uint64_t g = CounterRNG::kGamma;
+    // lane k holds the counter state of draw 3(i + k) + 1
+    __m256i state = _mm256_set_epi64x((long long)(key + 10 * g), (long long)(key + 7 * g), (long long)(key + 4 * g), (long long)(key + g));
+    const __m256i step1 = _mm256_set1_epi64x((long long)g), step12 = _mm256_set1_epi64x((long long)(12 * g));
+    const __m256d half = _mm256_set1_pd(0.5), two = _mm256_set1_pd(2.0), odds = _mm256_set1_pd(0.08);
+    const __m256d five = _mm256_set1_pd(5.0), ten = _mm256_set1_pd(10.0), floor3 = _mm256_set1_pd(3.0);
+    const __m256d scale = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d noise = _mm256_mul_pd(_mm256_sub_pd(loadUnitAvx2(state), half), two);
+        __m256d chance = loadUnitAvx2(_mm256_add_epi64(state, step1));
+        __m256d size = loadUnitAvx2(_mm256_add_epi64(state, _mm256_add_epi64(step1, step1)));
+        __m256d spike = _mm256_and_pd(_mm256_cmp_pd(chance, odds, _CMP_LT_OQ), _mm256_add_pd(five, _mm256_mul_pd(size, ten)));
+        __m256d v = _mm256_add_pd(_mm256_add_pd(_mm256_loadu_pd(shape + i), noise), spike);
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_max_pd(floor3, v), scale));
+        state = _mm256_add_epi64(state, step12);
+    }
+    // the tail continues the same streams
+    const CounterRNG rng(key);
+    for (; i < n; ++i) {
+        double noise = (rng.Double01At(3 * i) - 0.5) * 2.0;
+        double chance = rng.Double01At(3 * i + 1);
+        double spike = chance < 0.08 ? (5.0 + rng.Double01At(3 * i + 2) * 10.0) : 0.0;
+        out[i] = std::max(3.0, shape[i] + noise + spike) * factor;
+    }
+}
+#endif
+
+void simulateLoad(const double* shape, size_t n, uint64_t key, double factor, double* out) {
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) return simulateLoadAvx2(shape, n, key, factor, out);
+#endif
+    simulateLoadScalar(shape, n, key, factor, out);
+}
+
+void LoadModel::Day(uint32_t building, int64_t day, double* out) const {
+    simulateLoad(shape.data(), samplesPerDay, CounterRNG::Key(seed, building, day),
+        Scale(building) / (samplesPerDay / 24), out);
+}
+
+// Work for the generator threads: chunks of kDaysPerItem days of one building
+struct GenerateRun {
+    static const uint32_t kDaysPerItem = 32;
+    TimeSeriesStore* store;
+    const LoadModel* model;
+    uint32_t chunksPerBuilding;
+    uint32_t items;
+    std::atomic<uint32_t> next{ 0 };
+};
+
+DWORD WINAPI GenerateWorker(LPVOID param) {
+    GenerateRun& run = *(GenerateRun*)param;
+    TimeSeriesStore& store = *run.store;
+    for (uint32_t item; (item = run.next.fetch_add(1)) < run.items;) {
+        uint32_t b = item / run.chunksPerBuilding;
+        uint32_t first = item % run.chunksPerBuilding * GenerateRun::kDaysPerItem;
+        uint32_t last = std::min(first + GenerateRun::kDaysPerItem, store.DayCount());
+        uint32_t* masks = store.HourMasks(b);
+        for (uint32_t d = first; d < last; ++d) {
+            run.model->Day(b, store.FirstDay() + d, store.Samples(b, d));
+            store.RollupHourly(b, d);
+            masks[d] = 0xFFFFFFu;
+        }
+    }
+    return 0;
+}
+
+// Create a store of buildings x days synthetic days ending today and fill
+// it on workers threads (0 = one per core)
+bool GenerateSyntheticStore(const std::wstring& path, uint64_t seed, uint32_t buildings, uint32_t days,
+    uint32_t samplesPerDay, uint32_t workers, TimeSeriesStore& store) {
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    int64_t today = daysFromCivil(now.wYear, now.wMonth, now.wDay);
+    if (!store.Create(path, buildings, days, samplesPerDay, today - (int64_t)days + 1)) return false;
+    char name[32];
+    for (uint32_t b = 0; b < buildings; ++b) {
+        snprintf(name, sizeof(name), "Budova %u", b + 1);
+        store.SetBuilding(b, name, 3.20);
+    }
+    LoadModel model(seed, samplesPerDay);
+    GenerateRun run;
+    run.store = &store;
+    run.model = &model;
+    run.chunksPerBuilding = (days + GenerateRun::kDaysPerItem - 1) / GenerateRun::kDaysPerItem;
+    run.items = buildings * run.chunksPerBuilding;
+    if (!workers) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        workers = si.dwNumberOfProcessors;
+    }
+    workers = std::max(1u, std::min(workers, run.items));
+    std::vector<HANDLE> threads;
+    for (uint32_t w = 0; w < workers; ++w) {
+        HANDLE thread = CreateThread(NULL, 0, GenerateWorker, &run, 0, NULL);
+        if (thread) threads.push_back(thread);
+    }
+    if (threads.empty()) GenerateWorker(&run);
+    for (HANDLE thread : threads) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    return true;
+}
+
+// Command-line options of the GUI
+struct AppOptions {
+    std::wstring storePath;  // --store <file>: show a day from a time-series store (opened read-only)
+    std::wstring csvPath;    // --csv <file>: import a meter export and show one of its days (--store is then ignored)
+    std::wstring importStorePath; // --import-store <file>: new store file for the --csv import, which never
+                                  // overwrites an existing file; in memory without it
+    uint32_t building = 0;   // --building <index>
+    uint32_t day = 0;        // --day <index>
+    uint64_t seed = 0xC0FFEEULL; // --seed <n>: seed of the simulated day
+    std::vector<uint64_t> printers; // --printer AA:BB:CC:DD:EE:FF[,...], repeatable: BLE printers, file output otherwise
+    bool rasterPrint = false;    // --raster-print: print text sections as bitmaps too
+    std::wstring printerProfile = L"58mm"; // --printer-profile 58mm|80mm|star80mm: paper width and raster codec
+    std::wstring dither;         // --dither threshold|ordered|fs: print conversion, the profile's by default
+    std::wstring renderer = L"d2d"; // --renderer d2d|gdi: backend of the on-screen view
+    std::wstring tracePath;      // --trace <file>: write the timing samples as Chrome trace JSON on exit
+    // headless batch mode
+    std::wstring batchDir;       // --batch <dir>: render reports into dir without a window
+    std::wstring batchFormat = L"escpos"; // --format escpos|png|none
+    uint32_t jobs = 0;           // --jobs <n>: worker threads, 0 = one per core
+    uint32_t count = 1;          // --count <n>: simulated buildings when there is no store
+    uint32_t days = 1;           // --days <n>: stack n consecutive days in one scrollable view
+    std::wstring snapshotPath;   // --snapshot <file>: show days of a report snapshot, from --day on
+    std::wstring saveSnapshotPath; // --save-snapshot <file>: write the days shown at startup as a snapshot
+    // synthetic load
+    std::wstring generatePath;   // --generate <file>: write a synthetic store of --count buildings and exit
+    uint32_t generateDays = 365; // --generate-days <n>
+    uint32_t samplesPerDay = 1440; // --samples-per-day <n>: resolution of the generated store
+    // live mode
+    std::wstring liveSource;     // --live <csv file|sim>: follow a growing meter CSV or a simulated meter
+    uint32_t liveRate = 4;       // --live-rate <n>: repaints per second at most
+};
+static AppOptions g_options;
+static TimeSeriesStore g_store;
+static ReportSnapshot g_snapshot; // open for the whole run: shown days point into it
+static ImportStats g_importStats;
+
+uint64_t parseBluetoothAddress(const wchar_t* text);
+
+void ParseOptions(AppOptions& opts) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return;
+    for (int i = 1; i < argc; ++i) {
+        std::wstring arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == L"--store" && hasValue) opts.storePath = argv[++i];
+        else if (arg == L"--csv" && hasValue) opts.csvPath = argv[++i];
+        else if (arg == L"--import-store" && hasValue) opts.importStorePath = argv[++i];
+        else if (arg == L"--seed" && hasValue) opts.seed = wcstoull(argv[++i], NULL, 0);
+        else if (arg == L"--printer" && hasValue) {
+            std::wstring list = argv[++i];
+            for (size_t at = 0; at <= list.size();) {
+                size_t comma = std::min(list.find(L',', at), list.size());
+                uint64_t address = parseBluetoothAddress(list.substr(at, comma - at).c_str());
+                if (address) opts.printers.push_back(address);
+                at = comma + 1;
+            }
+        }
+        else if (arg == L"--building" && hasValue) opts.building = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--day" && hasValue) opts.day = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--raster-print") opts.rasterPrint = true;
+        else if (arg == L"--printer-profile" && hasValue) opts.printerProfile = argv[++i];
+        else if (arg == L"--dither" && hasValue) opts.dither = argv[++i];
+        else if (arg == L"--renderer" && hasValue) opts.renderer = argv[++i];
+        else if (arg == L"--trace" && hasValue) opts.tracePath = argv[++i];
+        else if (arg == L"--batch" && hasValue) opts.batchDir = argv[++i];
+        else if (arg == L"--format" && hasValue) opts.batchFormat = argv[++i];
+        else if (arg == L"--jobs" && hasValue) opts.jobs = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--count" && hasValue) opts.count = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--days" && hasValue) opts.days = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--snapshot" && hasValue) opts.snapshotPath = argv[++i];
+        else if (arg == L"--save-snapshot" && hasValue) opts.saveSnapshotPath = argv[++i];
+        else if (arg == L"--generate" && hasValue) opts.generatePath = argv[++i];
+        else if (arg == L"--generate-days" && hasValue) opts.generateDays = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--samples-per-day" && hasValue) opts.samplesPerDay = (uint32_t)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--live" && hasValue) opts.liveSource = argv[++i];
+        else if (arg == L"--live-rate" && hasValue) opts.liveRate = (uint32_t)wcstoul(argv[++i], NULL, 10);
+    }
+    LocalFree(argv);
+}
+
+// Load the day selected by the options, falling back to simulated data
+EnergyDay LoadInitialDay() {
+    if (!g_options.snapshotPath.empty()) {
+        LARGE_INTEGER start;
+        QueryPerformanceCounter(&start);
+        if (g_snapshot.Open(g_options.snapshotPath) && g_options.day < g_snapshot.DayCount()) {
+            EnergyDay day = g_snapshot.Day(g_options.day);
+            wchar_t msg[96];
+            swprintf(msg, 96, L"Snapshot: %u days, opened in %.3f ms\n", g_snapshot.DayCount(), secondsSince(start) * 1000.0);
+            OutputDebugStringW(msg);
+            return day;
+        }
+        g_snapshot.Close();
+        MessageBox(NULL, L"Could not open the report snapshot; showing simulated data.", L"Energetický report", MB_OK | MB_ICONWARNING);
+    } else if (!g_options.csvPath.empty()) {
+        // imported data lands in a new store file with --import-store, in memory otherwise
+        if (ImportMeterCsvToStore(g_options.csvPath, g_options.importStorePath, "Import: měřidlo", g_store, g_importStats)) {
+            wchar_t msg[160];
+            swprintf(msg, 160, L"CSV import: %.1f MB in %.3f s (%.1f MB/s), %llu samples, %llu rejected\n",
+                g_importStats.bytes / (1024.0 * 1024.0), g_importStats.seconds, g_importStats.MBps(),
+                (unsigned long long)g_importStats.samples, (unsigned long long)g_importStats.rejected);
+            OutputDebugStringW(msg);
+            if (g_importStats.outOfRange > 0) {
+                SYSTEMTIME first = civilFromDays(g_store.FirstDay());
+                SYSTEMTIME last = civilFromDays(g_store.FirstDay() + g_store.DayCount() - 1);
+                swprintf(msg, 160, L"%llu rows of the meter CSV are dated outside %04u-%02u-%02u .. %04u-%02u-%02u and were skipped.",
+                    (unsigned long long)g_importStats.outOfRange, first.wYear, first.wMonth, first.wDay, last.wYear, last.wMonth, last.wDay);
+                MessageBox(NULL, msg, L"Energetický report", MB_OK | MB_ICONWARNING);
+            }
+            return g_store.Day(0, std::min(g_options.day, g_store.DayCount() - 1));
+        }
+        if (!g_options.importStorePath.empty() && GetFileAttributesW(g_options.importStorePath.c_str()) != INVALID_FILE_ATTRIBUTES) {
+            MessageBox(NULL, (g_options.importStorePath + L" already exists and is never overwritten by an import; showing simulated data.").c_str(),
+                L"Energetický report", MB_OK | MB_ICONWARNING);
+        } else {
+            MessageBox(NULL, L"Could not import the meter CSV; showing simulated data.", L"Energetický report", MB_OK | MB_ICONWARNING);
+        }
+    } else if (!g_options.storePath.empty()) {
+        if (g_store.Open(g_options.storePath, false) &&
+            g_options.building < g_store.BuildingCount() && g_options.day < g_store.DayCount()) {
+            return g_store.Day(g_options.building, g_options.day);
+        }
+        MessageBox(NULL, L"Could not open the time-series store; showing simulated data.", L"Energetický report", MB_OK | MB_ICONWARNING);
+    }
+    return simulateEnergyDay(g_options.seed);
+}
+
+// Global pointer to hold the simulated data
+static EnergyDay g_day;
+// Bumped whenever g_day is replaced or modified so cached renderings know
+// they are stale.
+static uint64_t g_dayVersion = 0;
+// Bumped on every change of g_day, including incremental updates that only
+// invalidate single sections; keys cached print output.
+static uint64_t g_dayRevision = 0;
+// Days stacked below g_day in the scroll view (--days); printing and live
+// updates only ever touch g_day
+static std::vector<EnergyDay> g_moreDays;
+
+int ReportDayCount() { return 1 + (int)g_moreDays.size(); }
+const EnergyDay& ReportDay(int index) { return index == 0 ? g_day : g_moreDays[index - 1]; }
+
+// The days following first for --days: the next days of the same building
+// in the store, simulated days with consecutive seeds and dates otherwise.
+// A live view has no following days.
+void LoadFollowingDays(const EnergyDay& first) {
+    g_moreDays.clear();
+    if (!g_options.liveSource.empty()) return;
+    const uint32_t days = std::min<uint32_t>(g_options.days, 366);
+    if (g_snapshot.IsOpen()) {
+        for (uint32_t day = g_options.day + 1; day < g_options.day + days && day < g_snapshot.DayCount(); ++day)
+            g_moreDays.push_back(g_snapshot.Day(day));
+        return;
+    }
+    const bool imported = !g_options.csvPath.empty();
+    const uint32_t building = imported ? 0 : g_options.building;
+    const uint32_t firstDay = imported ? std::min(g_options.day, g_store.DayCount() - 1) : g_options.day;
+    const bool fromStore = building < g_store.BuildingCount() && firstDay < g_store.DayCount();
+    int64_t date = daysFromCivil(first.date.wYear, first.date.wMonth, first.date.wDay);
+    for (uint32_t k = 1; k < days; ++k) {
+        if (fromStore) {
+            uint32_t day = firstDay + k;
+            if (day >= g_store.DayCount()) break;
+            g_moreDays.push_back(g_store.Day(building, day));
+        } else {
+            EnergyDay next = simulateEnergyDay(g_options.seed + k);
+            next.date = civilFromDays(date + k);
+            g_moreDays.push_back(next);
+        }
+    }
+}
+
+// ---- GDI object cache ----
+// Process-wide cache of the fonts, pens and brushes used by the Draw*
+// functions. Objects are created on first use and kept until Clear() is
+// called on WM_DESTROY, so painting never creates or deletes GDI handles.
+// Returned handles are owned by the cache and must not be deleted.
+class GdiCache {
+public:
+    ~GdiCache() { Clear(); }
+    // Segoe UI at the given point size, keyed by (size, weight, DPI)
+    HFONT Font(int pointSize, int weight, int dpi) {
+        uint64_t key = MakeKey(KindFont, (uint64_t)(pointSize & 0xFFFF) << 32 | (uint64_t)(weight & 0xFFFF) << 16 | (uint64_t)(dpi & 0xFFFF));
+        HGDIOBJ& obj = objects[key];
+        if (!obj) {
+            obj = CreateFontW(-MulDiv(pointSize, dpi, 72), 0, 0, 0,
+                weight, FALSE, FALSE, FALSE,
+                DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, L"Segoe UI");
+        }
+        return (HFONT)obj;
+    }
+    // Pen keyed by (style, width, color)
+    HPEN Pen(int style, int width, COLORREF color) {
+        uint64_t key = MakeKey(KindPen, (uint64_t)(style & 0xFF) << 40 | (uint64_t)(width & 0xFF) << 32 | color);
+        HGDIOBJ& obj = objects[key];
+        if (!obj) obj = CreatePen(style, width, color);
+        return (HPEN)obj;
+    }
+    // Hatch brush keyed by (hatch style, color)
+    HBRUSH HatchBrush(int hatch, COLORREF color) {
+        uint64_t key = MakeKey(KindHatchBrush, (uint64_t)(hatch & 0xFF) << 32 | color);
+        HGDIOBJ& obj = objects[key];
+        if (!obj) obj = CreateHatchBrush(hatch, color);
+        return (HBRUSH)obj;
+    }
+    HBRUSH SolidBrush(COLORREF color) {
+        uint64_t key = MakeKey(KindSolidBrush, color);
+        HGDIOBJ& obj = objects[key];
+        if (!obj) obj = CreateSolidBrush(color);
+        return (HBRUSH)obj;
+    }
+    size_t Size() const { return objects.size(); }
+    // Delete every cached object. Callers must have deselected them first.
+    void Clear() {
+        for (auto& kv : objects) if (kv.second) DeleteObject(kv.second);
+        objects.clear();
+    }
+private:
+    enum Kind : uint64_t { KindFont = 1, KindPen = 2, KindHatchBrush = 3, KindSolidBrush = 4 };
+    static uint64_t MakeKey(Kind kind, uint64_t fields) { return (uint64_t)kind << 56 | (fields & 0x00FFFFFFFFFFFFFFULL); }
+    std::unordered_map<uint64_t, HGDIOBJ> objects;
+};
+static GdiCache g_gdi;
+
+// Forward declarations of drawing functions. They are templates over the
+// report schema: ScreenSchema for the window and batch pages,
+// PaperSchema<dots> for printer rasters (see "Report schema").
+class Renderer;
+struct ScreenSchema;
+template <class Schema> void DrawHeader(Renderer& r, RECT& area);
+template <class Schema> void DrawLineChart(Renderer& r, RECT& area);
+template <class Schema> void DrawBarChart(Renderer& r, RECT& area);
+template <class Schema> void DrawPieChart(Renderer& r, RECT& area);
+template <class Schema> void DrawTable(Renderer& r, RECT& area);
+template <class Schema> void DrawChecklist(Renderer& r, RECT& area);
+typedef void (*SectionDrawFn)(Renderer& r, RECT& area);
+
+// Text-mode printing of the sections that are (nearly) pure text
+struct PrinterProfile;
+void PrintHeaderText(const PrinterProfile& profile, std::vector<uint8_t>& out);
+void PrintTableText(const PrinterProfile& profile, std::vector<uint8_t>& out);
+void PrintChecklistText(const PrinterProfile& profile, std::vector<uint8_t>& out);
+void PrintSectionTitleText(const PrinterProfile& profile, int section, std::vector<uint8_t>& out);
+
+// Forward declarations for printing
+void PrintReport(HWND hwnd);
+struct PrintJob;
+void FinishPrintJob(PrintJob* job);
+
+// ---- Report layout and back buffer ----
+// The report is a vertical stack of sections. Each one has a fixed height and
+// spans the window width, so the whole layout only depends on the width.
+enum SectionId {
+    SectionHeader,
+    SectionLine,
+    SectionBar,
+    SectionPie,
+    SectionTable,
+    SectionChecklist,
+    SectionCount
+};
+
+struct SectionInfo {
+    int height;
+    const wchar_t* title;
+    SectionDrawFn draw;  // on-screen instantiation
+    // ESC/POS text version for hybrid printing, below the title;
+    // nullptr: always rasterized
+    void (*printText)(const PrinterProfile& profile, std::vector<uint8_t>& out);
+};
+
+static constexpr SectionInfo kSections[SectionCount] = {
+    { 190, L"Denní energetický report", DrawHeader<ScreenSchema>, PrintHeaderText },
+    { 260, L"Časová osa (kWh/h)", DrawLineChart<ScreenSchema>, nullptr },
+    { 250, L"Top spotřebiče (kWh/den)", DrawBarChart<ScreenSchema>, nullptr },
+    { 300, L"Rozpad kategorií (podíl)", DrawPieChart<ScreenSchema>, nullptr },
+    { 320, L"Tabulka (výběr hodin)", DrawTable<ScreenSchema>, PrintTableText },
+    { 240, L"Checklist / Alerts", DrawChecklist<ScreenSchema>, PrintChecklistText }
+};
+
+// Every section starts with its title and a rule in the rows above
+// kTitleRows (96-DPI units) and draws nothing that depends on the day
+// there, so printers get that band from a precompiled template. A multiple
+// of 4 keeps the ordered dither's phase when the rest is rendered alone.
+constexpr int kTitleRows = 40;
+static_assert(kTitleRows % 4 == 0, "the title band must keep the 4x4 dither phase");
+
+constexpr int maxSectionHeight() {
+    int height = 0;
+    for (const SectionInfo& info : kSections) height = info.height > height ? info.height : height;
+    return height;
+}
+// rows of the printer raster every section is rendered into
+constexpr int kMaxSectionHeight = maxSectionHeight();
+
+// Rectangles of all sections for one report width and DPI. Section heights
+// and every offset in the Draw* functions are in 96-DPI units; Px() scales
+// them to the layout's DPI.
+struct ReportLayout {
+    int width = 0;
+    int dpi = 96;
+    RECT sections[SectionCount] = {};
+    int height = 0;
+    int Px(int v) const { return MulDiv(v, dpi, 96); }
+};
+
+ReportLayout LayoutReport(int width, int dpi = 96) {
+    ReportLayout layout;
+    layout.width = width;
+    layout.dpi = dpi;
+    // sections are separated vertically with margins; the first one leaves room for the buttons
+    const int margin = layout.Px(10);
+    int y = margin + layout.Px(40);
+    for (int i = 0; i < SectionCount; ++i) {
+        layout.sections[i] = { margin, y, width - margin, y + layout.Px(kSections[i].height) };
+        y = layout.sections[i].bottom + margin;
+    }
+    layout.height = y;
+    return layout;
+}
+
+// Layout of the main window. It only changes on WM_SIZE and WM_DPICHANGED
+// (UpdateLayout); painting, InvalidateSection and the Draw* functions read it.
+static ReportLayout g_layout;
+
+#ifndef WM_DPICHANGED
+#define WM_DPICHANGED 0x02E0
+#endif
+
+// Per-monitor DPI functions exist from Windows 10 1703 on; they are looked
+// up at run time so older systems and SDK headers still work (at 96 DPI).
+void EnablePerMonitorDpi() {
+    typedef BOOL (WINAPI* SetContextFn)(HANDLE);
+    SetContextFn fn = (SetContextFn)(void*)GetProcAddress(GetModuleHandleW(L"user32.dll"), "SetProcessDpiAwarenessContext");
+    if (fn) fn((HANDLE)(intptr_t)-4); // DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2
+}
+
+int WindowDpi(HWND hwnd) {
+    typedef UINT (WINAPI* GetDpiFn)(HWND);
+    static GetDpiFn fn = (GetDpiFn)(void*)GetProcAddress(GetModuleHandleW(L"user32.dll"), "GetDpiForWindow");
+    UINT dpi = fn ? fn(hwnd) : 0;
+    return dpi ? (int)dpi : 96;
+}
+
+// Recompute g_layout for the current client width and monitor DPI; false
+// when nothing changed
+bool UpdateLayout(HWND hwnd) {
+    RECT client;
+    GetClientRect(hwnd, &client);
+    int width = std::max(1, (int)(client.right - client.left));
+    int dpi = WindowDpi(hwnd);
+    if (width == g_layout.width && dpi == g_layout.dpi) return false;
+    g_layout = LayoutReport(width, dpi);
+    return true;
+}
+
+// ---- Render binding ----
+// The Draw* functions render the day with the GDI cache and layout metrics
+// bound to the calling thread. The UI thread draws g_day with g_gdi and
+// g_layout; background renderers
+// bind a private snapshot and their own cache with ScopedRenderBinding, so
+// they never share the (unsynchronized) cache or a day that is being updated.
+// Renderers that draw each day once (batch pages) clear shareCharts, so they
+// neither contend for nor evict the window's entries in the chart caches.
+struct RenderBinding {
+    const EnergyDay* day;
+    GdiCache* gdi;
+    const ReportLayout* layout;
+    bool shareCharts;
+};
+thread_local RenderBinding t_render = { &g_day, &g_gdi, &g_layout, true };
+
+inline const EnergyDay& CurrentDay() { return *t_render.day; }
+inline GdiCache& CurrentGdi() { return *t_render.gdi; }
+inline const ReportLayout& CurrentLayout() { return *t_render.layout; }
+inline bool SharesChartCaches() { return t_render.shareCharts; }
+
+class ScopedRenderBinding {
+public:
+    ScopedRenderBinding(const EnergyDay* day, GdiCache* gdi, const ReportLayout* layout, bool shareCharts = true)
+        : saved(t_render) { t_render = { day, gdi, layout, shareCharts }; }
+    ~ScopedRenderBinding() { t_render = saved; }
+    ScopedRenderBinding(const ScopedRenderBinding&) = delete;
+    ScopedRenderBinding& operator=(const ScopedRenderBinding&) = delete;
+private:
+    RenderBinding saved;
+};
+
+// Deep copy of a day whose samples no longer alias the source buffers
+EnergyDay snapshotDay(const EnergyDay& src) {
+    EnergyDay day = src;
+    SampleBuffer hourly = SampleBuffer::Allocate(src.hourlyKWh.size());
+    std::copy(src.hourlyKWh.begin(), src.hourlyKWh.end(), hourly.begin());
+    day.hourlyKWh = hourly;
+    if (src.samples.data() == src.hourlyKWh.data()) {
+        day.samples = day.hourlyKWh;
+    } else {
+        SampleBuffer samples = SampleBuffer::Allocate(src.samples.size());
+        std::copy(src.samples.begin(), src.samples.end(), samples.begin());
+        day.samples = samples;
+    }
+    return day;
+}
+
+// ---- Report schema ----
+// Everything the Draw* functions place besides their fixed 96-DPI offsets:
+// table columns, tick hours, where the bars and the pie go, and the
+// checklist rules. The window and batch pages draw with ScreenSchema, which
+// scales by the bound layout's DPI at run time. Printer rasters draw with
+// the PaperSchema specialization for their paper width. Printers take one
+// dot per 96-DPI unit, so Px() is the identity there and the print
+// instantiations fold their layout math to constants.
+enum { TableColumnCount = 4 };
+constexpr const wchar_t* kTableColumns[TableColumnCount] = { L"Hod", L"kWh", L"Kč", L"Pozn." };
+
+struct TickSet {
+    int count;
+    int hours[12];
+};
+
+struct ReportGeometry {
+    int barX;                           // bar chart: left edge of the bars
+    int pieCenterX, pieRadius;
+    int legendX;                        // pie chart: left edge of the legend
+    int columnX[TableColumnCount];      // table: left edge of each column
+    TickSet ticks;                      // line chart: labelled hours
+};
+
+// Compile-time check that a geometry fits a report width
+constexpr bool geometryFits(const ReportGeometry& g, int width) {
+    if (g.barX + 40 > width - 10 || g.legendX + 150 > width || g.pieCenterX - g.pieRadius < 10 ||
+        g.pieCenterX + g.pieRadius > g.legendX - 10 || g.columnX[TableColumnCount - 1] + 30 > width - 10) return false;
+    for (int c = 1; c < TableColumnCount; ++c) if (g.columnX[c] <= g.columnX[c - 1]) return false;
+    if (g.ticks.count < 2 || g.ticks.count > 12) return false;
+    for (int k = 0; k < g.ticks.count; ++k) {
+        if (g.ticks.hours[k] < 0 || g.ticks.hours[k] > 23 || (k && g.ticks.hours[k] <= g.ticks.hours[k - 1])) return false;
+    }
+    return true;
+}
+
+struct ScreenSchema {
+    const ReportLayout& layout = CurrentLayout();
+    int Px(int v) const { return layout.Px(v); }
+    static constexpr ReportGeometry geometry = { 170, 100, 70, 200, { 10, 80, 160, 280 }, { 5, { 0, 6, 12, 18, 23 } } };
+};
+
+// Specialized for the paper widths in dots below; others do not compile
+template <int Dots> struct PaperSchema;
+
+// 58 mm: a narrower label column and pie
+template <> struct PaperSchema<384> {
+    static constexpr int Px(int v) { return v; }
+    static constexpr ReportGeometry geometry = { 150, 75, 60, 150, { 10, 70, 140, 250 }, { 5, { 0, 6, 12, 18, 23 } } };
+};
+
+// 80 mm: wider columns, a tick every three hours
+template <> struct PaperSchema<576> {
+    static constexpr int Px(int v) { return v; }
+    static constexpr ReportGeometry geometry = { 200, 100, 70, 200, { 10, 110, 210, 340 }, { 9, { 0, 3, 6, 9, 12, 15, 18, 21, 23 } } };
+};
+
+static_assert(geometryFits(ScreenSchema::geometry, 384), "screen geometry must fit the narrowest window");
+static_assert(geometryFits(PaperSchema<384>::geometry, 384), "58 mm geometry must fit 384 dots");
+static_assert(geometryFits(PaperSchema<576>::geometry, 576), "80 mm geometry must fit 576 dots");
+
+// Draw* of one paper width, indexed by SectionId
+template <int Dots>
+struct PaperSections {
+    static constexpr SectionDrawFn draw[SectionCount] = {
+        DrawHeader<PaperSchema<Dots>>,
+        DrawLineChart<PaperSchema<Dots>>,
+        DrawBarChart<PaperSchema<Dots>>,
+        DrawPieChart<PaperSchema<Dots>>,
+        DrawTable<PaperSchema<Dots>>,
+        DrawChecklist<PaperSchema<Dots>>
+    };
+};
+
+// Checklist rows, shared by DrawChecklist and PrintChecklistText
+struct AlertSpec {
+    const wchar_t* text;
+    bool (*ok)(const EnergyStats& stats);
+};
+
+constexpr AlertSpec kAlerts[] = {
+    { L"Noční zátěž v normě", [](const EnergyStats& s) { return !s.nightHigh; } },
+    { L"Žádná extrémní špička (> 2.0× průměr)", [](const EnergyStats& s) { return !s.extremePeak; } },
+    { L"Křivka bez výpadků (24/24)", [](const EnergyStats& s) { return s.complete; } },
+    { L"Doporučení: zkontrolovat HVAC plán", [](const EnergyStats&) { return true; } },
+    { L"Doporučení: audit osvětlení (zóny)", [](const EnergyStats&) { return true; } }
+};
+
+// ---- Chart geometry cache ----
+// DrawPieChart and DrawBarChart take their numbers from here instead of
+// redoing them on every paint. ChartData only depends on the breakdown of a
+// day (EnergyDay::chartRevision): slice angles with their unit-circle
+// endpoints, bar fractions and the legend and value labels. The screen and
+// every printer width share it, so the trigonometry runs once per
+// breakdown. PlacedChart scales ChartData to one section size, DPI and
+// schema geometry, relative to the section's top-left corner. Entries are
+// only replaced when the breakdown or the layout changes their key. The UI
+// thread, the spooler and batch workers all use the same caches.
+struct PieWedge {
+    int cx, cy, radius;
+    double a0, a1;              // radians, clockwise from +x
+    double cos0, sin0, cos1, sin1;
+    POINT from, to;             // integer arc endpoints for GDI's Pie()
+};
+
+struct ChartData {
+    // pie chart, one entry per category
+    std::vector<double> angles;       // slice i spans angles[i] .. angles[i + 1]
+    std::vector<double> cosines, sines;
+    std::vector<Label> legend;        // "1) name  42%"
+    // bar chart, one entry per top consumer
+    std::vector<double> barFractions; // of the largest bar
+    std::vector<Label> barValues;
+};
+
+struct PlacedChart {
+    std::shared_ptr<const ChartData> data;
+    // pie chart
+    std::vector<PieWedge> wedges;
+    int legendX = 0;
+    std::vector<int> legendY;
+    // bar chart
+    int barX = 0, barWidth = 0;
+    std::vector<int> barY;
+    std::vector<int> barFill;         // filled width of each bar
+};
+
+// Small LRU of immutable values shared between threads. Readers keep their
+// shared_ptr, so an entry evicted meanwhile stays valid until they are done.
+// Hits only take the lock shared; their use stamps are atomic.
+template <class Key, class Value, size_t N>
+class SharedLru {
+public:
+    std::shared_ptr<const Value> Find(const Key& key) {
+        AcquireSRWLockShared(&lock);
+        std::shared_ptr<const Value> found;
+        for (size_t i = 0; i < count; ++i) {
+            Entry& e = entries[i];
+            if (e.key == key) {
+                e.lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                found = e.value;
+                break;
+            }
+        }
+        ReleaseSRWLockShared(&lock);
+        return found;
+    }
+    void Insert(const Key& key, std::shared_ptr<const Value> value) {
+        AcquireSRWLockExclusive(&lock);
+        size_t slot = count;
+        if (count < N) {
+            ++count;
+        } else {
+            slot = 0;
+            for (size_t i = 1; i < N; ++i) {
+                if (entries[i].lastUse.load(std::memory_order_relaxed) < entries[slot].lastUse.load(std::memory_order_relaxed)) slot = i;
+            }
+        }
+        entries[slot].key = key;
+        entries[slot].value = std::move(value);
+        entries[slot].lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        ReleaseSRWLockExclusive(&lock);
+    }
+private:
+    struct Entry {
+        Key key{};
+        std::shared_ptr<const Value> value;
+        std::atomic<uint64_t> lastUse{ 0 };
+    };
+    SRWLOCK lock = SRWLOCK_INIT;
+    Entry entries[N];
+    size_t count = 0;
+    std::atomic<uint64_t> useClock{ 0 };
+};
+
+enum ChartKind { ChartPie, ChartBar };
+
+struct PlacedChartKey {
+    uint64_t revision;
+    ChartKind kind;
+    int width, height, dpi;
+    const ReportGeometry* geometry;   // identifies the schema
+    bool operator==(const PlacedChartKey& o) const {
+        return revision == o.revision && kind == o.kind && width == o.width && height == o.height && dpi == o.dpi && geometry == o.geometry;
+    }
+};
+
+static SharedLru<uint64_t, ChartData, 16> g_chartData;
+static SharedLru<PlacedChartKey, PlacedChart, 32> g_placedCharts;
+
+std::shared_ptr<const ChartData> chartData(const EnergyDay& day) {
+    const bool shared = SharesChartCaches();
+    if (shared) {
+        if (std::shared_ptr<const ChartData> found = g_chartData.Find(day.chartRevision)) return found;
+    }
+    std::shared_ptr<ChartData> data = std::make_shared<ChartData>();
+    double total = 0.0;
+    for (const Category& c : day.categoryBreakdown) total += c.kWh;
+    double angle = -3.14159265358979323846 / 2; // -90 deg
+    for (size_t i = 0; i <= day.categoryBreakdown.size(); ++i) {
+        data->angles.push_back(angle);
+        data->cosines.push_back(std::cos(angle));
+        data->sines.push_back(std::sin(angle));
+        if (i == day.categoryBreakdown.size()) break;
+        const Category& cat = day.categoryBreakdown[i];
+        angle += cat.kWh / total * 2 * 3.14159265358979323846;
+        Label line;
+        line.Int(i + 1).Add(L") ").Add(cat.name).Add(L"  ").Fixed(100.0 * cat.kWh / total, 0).Add(L'%');
+        data->legend.push_back(line);
+    }
+    double maxV = 1.0;
+    for (const Consumer& c : day.topConsumers) if (c.kWh > maxV) maxV = c.kWh;
+    for (const Consumer& c : day.topConsumers) {
+        data->barFractions.push_back(c.kWh / maxV);
+        data->barValues.push_back(Label().Fixed(c.kWh, 1));
+    }
+    if (shared) g_chartData.Insert(day.chartRevision, data);
+    return data;
+}
+
+// Geometry of the pie or bar chart of the bound day in a section of size
+// area, placed with the schema m
+template <class Schema>
+std::shared_ptr<const PlacedChart> placedChart(ChartKind kind, const RECT& area, const Schema& m) {
+    const EnergyDay& day = CurrentDay();
+    const int width = area.right - area.left;
+    const PlacedChartKey key = { day.chartRevision, kind, width, area.bottom - area.top, CurrentLayout().dpi, &Schema::geometry };
+    const bool shared = SharesChartCaches();
+    if (shared) {
+        if (std::shared_ptr<const PlacedChart> found = g_placedCharts.Find(key)) return found;
+    }
+    std::shared_ptr<PlacedChart> chart = std::make_shared<PlacedChart>();
+    chart->data = chartData(day);
+    const ChartData& data = *chart->data;
+    if (kind == ChartPie) {
+        const int cx = m.Px(m.geometry.pieCenterX), cy = m.Px(170), radius = m.Px(m.geometry.pieRadius);
+        for (size_t i = 0; i + 1 < data.angles.size(); ++i) {
+            PieWedge w = { cx, cy, radius, data.angles[i], data.angles[i + 1],
+                data.cosines[i], data.sines[i], data.cosines[i + 1], data.sines[i + 1], {}, {} };
+            w.from = { cx + (int)(radius * w.cos0), cy + (int)(radius * w.sin0) };
+            w.to = { cx + (int)(radius * w.cos1), cy + (int)(radius * w.sin1) };
+            chart->wedges.push_back(w);
+            chart->legendY.push_back(m.Px(90) + (int)i * m.Px(22));
+        }
+        chart->legendX = m.Px(m.geometry.legendX);
+    } else {
+        chart->barX = m.Px(m.geometry.barX);
+        chart->barWidth = width - chart->barX - m.Px(10);
+        for (size_t i = 0; i < data.barFractions.size(); ++i) {
+            chart->barY.push_back(m.Px(60) + (int)i * m.Px(28));
+            chart->barFill.push_back((int)(chart->barWidth * data.barFractions[i]));
+        }
+    }
+    if (shared) g_placedCharts.Insert(key, chart);
+    return chart;
+}
+
+// ---- Renderer backends ----
+// The Draw* functions describe a section with the primitives below; all
+// coordinates are device pixels of the bound layout. GdiRenderer draws into
+// any DC and stays the only backend for printer rasters and batch pages,
+// whose 1-bpp conversion wants aliased pixels. D2DRenderer draws the
+// on-screen sections antialiased with Direct2D and DirectWrite.
+class Renderer {
+public:
+    virtual ~Renderer() {}
+    virtual void Fill(const RECT& r, COLORREF color) = 0;
+    // white rectangle with a black outline of the given width
+    virtual void Frame(const RECT& r, int width) = 0;
+    virtual void Line(int x0, int y0, int x1, int y1, int width, COLORREF color) = 0;
+    virtual void Polyline(const POINT* points, size_t count, int width, COLORREF color) = 0;
+    // filled black circle
+    virtual void Dot(int cx, int cy, int radius) = 0;
+    // slice filled with a black HS_* hatch and outlined in black
+    virtual void PieSlice(const PieWedge& w, int hatch, int width) = 0;
+    // fontSize is in points at the layout's DPI; TA_RIGHT aligns the text's
+    // right edge on x
+    virtual void TextRun(int x, int y, const wchar_t* text, size_t length, int fontSize, bool bold, UINT align) = 0;
+
+    void Text(int x, int y, const Label& text, int fontSize = 14, bool bold = false, UINT align = TA_LEFT) {
+        TextRun(x, y, text.data(), text.size(), fontSize, bold, align);
+    }
+    void Text(int x, int y, std::wstring_view text, int fontSize = 14, bool bold = false, UINT align = TA_LEFT) {
+        TextRun(x, y, text.data(), text.size(), fontSize, bold, align);
+    }
+    template <size_t N>
+    void Text(int x, int y, const wchar_t (&text)[N], int fontSize = 14, bool bold = false, UINT align = TA_LEFT) {
+        TextRun(x, y, text, N - 1, fontSize, bold, align);
+    }
+};
+
+// GDI backend over the cache and DPI of the calling thread's render binding
+class GdiRenderer : public Renderer {
+public:
+    explicit GdiRenderer(HDC dc) : dc(dc), gdi(CurrentGdi()), dpi(CurrentLayout().dpi) { SetBkMode(dc, TRANSPARENT); }
+
+    void Fill(const RECT& r, COLORREF color) override {
+        FillRect(dc, &r, gdi.SolidBrush(color));
+    }
+    void Frame(const RECT& r, int width) override {
+        HGDIOBJ oldPen = SelectObject(dc, gdi.Pen(PS_SOLID, width, RGB(0,0,0)));
+        HGDIOBJ oldBrush = SelectObject(dc, GetStockObject(WHITE_BRUSH));
+        Rectangle(dc, r.left, r.top, r.right, r.bottom);
+        SelectObject(dc, oldBrush);
+        SelectObject(dc, oldPen);
+    }
+    void Line(int x0, int y0, int x1, int y1, int width, COLORREF color) override {
+        HGDIOBJ old = SelectObject(dc, gdi.Pen(PS_SOLID, width, color));
+        MoveToEx(dc, x0, y0, NULL);
+        LineTo(dc, x1, y1);
+        SelectObject(dc, old);
+    }
+    void Polyline(const POINT* points, size_t count, int width, COLORREF color) override {
+        if (count < 2) return;
+        HGDIOBJ old = SelectObject(dc, gdi.Pen(PS_SOLID, width, color));
+        ::Polyline(dc, points, (int)count);
+        SelectObject(dc, old);
+    }
+    void Dot(int cx, int cy, int radius) override {
+        HGDIOBJ oldPen = SelectObject(dc, GetStockObject(BLACK_PEN));
+        HGDIOBJ oldBrush = SelectObject(dc, GetStockObject(BLACK_BRUSH));
+        Ellipse(dc, cx - radius, cy - radius, cx + radius, cy + radius);
+        SelectObject(dc, oldBrush);
+        SelectObject(dc, oldPen);
+    }
+    void PieSlice(const PieWedge& w, int hatch, int width) override {
+        HGDIOBJ oldBrush = SelectObject(dc, gdi.HatchBrush(hatch, RGB(0,0,0)));
+        HGDIOBJ oldPen = SelectObject(dc, gdi.Pen(PS_SOLID, width, RGB(0,0,0)));
+        Pie(dc, w.cx - w.radius, w.cy - w.radius, w.cx + w.radius, w.cy + w.radius, w.from.x, w.from.y, w.to.x, w.to.y);
+        SelectObject(dc, oldPen);
+        SelectObject(dc, oldBrush);
+    }
+    void TextRun(int x, int y, const wchar_t* text, size_t length, int fontSize, bool bold, UINT align) override {
+        HGDIOBJ old = SelectObject(dc, gdi.Font(fontSize, bold ? FW_BOLD : FW_NORMAL, dpi));
+        UINT oldAlign = SetTextAlign(dc, align | TA_TOP);
+        TextOutW(dc, x, y, text, (int)length);
+        SetTextAlign(dc, oldAlign);
+        SelectObject(dc, old);
+    }
+
+private:
+    HDC dc;
+    GdiCache& gdi;
+    int dpi;
+};
+
+#if defined(ER_HAVE_D2D)
+template <class T> void releaseCom(T*& p) {
+    if (p) p->Release();
+    p = nullptr;
+}
+
+// Direct2D backend for the UI thread. It renders into the section bitmaps
+// through a DC render target, so the section cache and ScrollWindowEx keep
+// working unchanged. Text layouts and pie geometries are cached across
+// frames and rebuilt only when their text, size or shape changes. The
+// factories are loaded at run time; Init() fails on systems without them
+// and the caller keeps using GDI.
+class D2DRenderer : public Renderer {
+public:
+    ~D2DRenderer() { Shutdown(); }
+
+    bool Init() {
+        if (factory) return true;
+        typedef HRESULT (WINAPI* D2DCreateFn)(D2D1_FACTORY_TYPE, REFIID, const D2D1_FACTORY_OPTIONS*, void**);
+        typedef HRESULT (WINAPI* DWriteCreateFn)(DWRITE_FACTORY_TYPE, REFIID, IUnknown**);
+        HMODULE d2d = LoadLibraryW(L"d2d1.dll");
+        HMODULE dw = LoadLibraryW(L"dwrite.dll");
+        D2DCreateFn createD2D = d2d ? (D2DCreateFn)(void*)GetProcAddress(d2d, "D2D1CreateFactory") : nullptr;
+        DWriteCreateFn createDWrite = dw ? (DWriteCreateFn)(void*)GetProcAddress(dw, "DWriteCreateFactory") : nullptr;
+        if (!createD2D || !createDWrite) return false;
+        if (FAILED(createD2D(D2D1_FACTORY_TYPE_SINGLE_THREADED, __uuidof(ID2D1Factory), nullptr, (void**)&factory))) return false;
+        if (FAILED(createDWrite(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory), (IUnknown**)&dwrite))) {
+            releaseCom(factory);
+            return false;
+        }
+        return true;
+    }
+
+    void Shutdown() {
+        ReleaseTarget();
+        ClearLayouts();
+        for (auto& kv : formats) kv.second->Release();
+        formats.clear();
+        for (auto& kv : pies) kv.second.geometry->Release();
+        pies.clear();
+        releaseCom(dwrite);
+        releaseCom(factory);
+    }
+
+    // Bind the memory DC and start drawing into bounds of it
+    bool Begin(HDC dc, const RECT& bounds) {
+        if (!factory || (!target && !CreateTarget())) return false;
+        if (FAILED(target->BindDC(dc, &bounds))) return false;
+        target->BeginDraw();
+        return true;
+    }
+
+    // False when the device was lost; the caller redraws that section with
+    // GDI and the next Begin() recreates the target
+    bool End() {
+        HRESULT hr = target->EndDraw(nullptr, nullptr);
+        if (hr == D2DERR_RECREATE_TARGET) ReleaseTarget();
+        return SUCCEEDED(hr);
+    }
+
+    void Fill(const RECT& r, COLORREF color) override {
+        D2D1_RECT_F rect = { (FLOAT)r.left, (FLOAT)r.top, (FLOAT)r.right, (FLOAT)r.bottom };
+        target->FillRectangle(&rect, Brush(color));
+    }
+    void Frame(const RECT& r, int width) override {
+        Fill(r, RGB(255,255,255));
+        // the stroke lies inside the rectangle, like a GDI pen
+        FLOAT h = width * 0.5f;
+        D2D1_RECT_F rect = { r.left + h, r.top + h, r.right - h, r.bottom - h };
+        target->DrawRectangle(&rect, Brush(RGB(0,0,0)), (FLOAT)width, nullptr);
+    }
+    void Line(int x0, int y0, int x1, int y1, int width, COLORREF color) override {
+        target->DrawLine(Point(x0, y0), Point(x1, y1), Brush(color), (FLOAT)width, nullptr);
+    }
+    void Polyline(const POINT* points, size_t count, int width, COLORREF color) override {
+        if (count < 2) return;
+        ID2D1PathGeometry* path = nullptr;
+        ID2D1GeometrySink* sink = nullptr;
+        if (FAILED(factory->CreatePathGeometry(&path))) return;
+        if (SUCCEEDED(path->Open(&sink))) {
+            sink->BeginFigure(Point(points[0].x, points[0].y), D2D1_FIGURE_BEGIN_HOLLOW);
+            for (size_t i = 1; i < count; ++i) sink->AddLine(Point(points[i].x, points[i].y));
+            sink->EndFigure(D2D1_FIGURE_END_OPEN);
+            if (SUCCEEDED(sink->Close())) target->DrawGeometry(path, Brush(color), (FLOAT)width, nullptr);
+            sink->Release();
+        }
+        path->Release();
+    }
+    void Dot(int cx, int cy, int radius) override {
+        D2D1_ELLIPSE e = { Point(cx, cy), (FLOAT)radius, (FLOAT)radius };
+        target->FillEllipse(&e, Brush(RGB(0,0,0)));
+    }
+    void PieSlice(const PieWedge& w, int hatch, int width) override {
+        ID2D1PathGeometry* slice = PieGeometry(w);
+        if (!slice) return;
+        if (ID2D1BitmapBrush* pattern = Hatch(hatch)) target->FillGeometry(slice, pattern, nullptr);
+        target->DrawGeometry(slice, Brush(RGB(0,0,0)), (FLOAT)width, nullptr);
+    }
+    void TextRun(int x, int y, const wchar_t* text, size_t length, int fontSize, bool bold, UINT align) override {
+        IDWriteTextLayout* layout = TextLayout(text, length, MulDiv(fontSize, CurrentLayout().dpi, 72), bold);
+        if (!layout) return;
+        FLOAT left = (FLOAT)x;
+        if (align & TA_RIGHT) {
+            DWRITE_TEXT_METRICS metrics;
+            if (SUCCEEDED(layout->GetMetrics(&metrics))) left -= metrics.widthIncludingTrailingWhitespace;
+        }
+        D2D1_POINT_2F origin = { left, (FLOAT)y };
+        target->DrawTextLayout(origin, layout, Brush(RGB(0,0,0)), D2D1_DRAW_TEXT_OPTIONS_NONE);
+    }
+
+private:
+    static const size_t kMaxLayouts = 2048;
+    static const size_t kMaxPies = 64;
+
+    // pixel centers, so odd-width strokes land on whole pixels
+    static D2D1_POINT_2F Point(int x, int y) { return { x + 0.5f, y + 0.5f }; }
+
+    bool CreateTarget() {
+        D2D1_RENDER_TARGET_PROPERTIES props = {};
+        props.type = D2D1_RENDER_TARGET_TYPE_DEFAULT;
+        props.pixelFormat.format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        props.pixelFormat.alphaMode = D2D1_ALPHA_MODE_IGNORE;
+        // 96 DPI: one DIP is one pixel, the layout already scaled everything
+        props.dpiX = 96.0f;
+        props.dpiY = 96.0f;
+        return SUCCEEDED(factory->CreateDCRenderTarget(&props, &target));
+    }
+
+    // device-dependent resources go with the target
+    void ReleaseTarget() {
+        for (auto& kv : solids) releaseCom(kv.second);
+        solids.clear();
+        for (ID2D1BitmapBrush*& h : hatches) releaseCom(h);
+        releaseCom(target);
+    }
+
+    ID2D1SolidColorBrush* Brush(COLORREF color) {
+        ID2D1SolidColorBrush*& brush = solids[color];
+        if (!brush) {
+            D2D1_COLOR_F c = { GetRValue(color) / 255.0f, GetGValue(color) / 255.0f, GetBValue(color) / 255.0f, 1.0f };
+            target->CreateSolidColorBrush(&c, nullptr, &brush);
+        }
+        return brush;
+    }
+
+    // 8x8 tile of the GDI hatch style, black on transparent
+    ID2D1BitmapBrush* Hatch(int style) {
+        if (style < 0 || style > HS_DIAGCROSS) return nullptr;
+        ID2D1BitmapBrush*& brush = hatches[style];
+        if (brush) return brush;
+        uint32_t tile[64];
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                bool on = (style == HS_HORIZONTAL && y == 0) || (style == HS_VERTICAL && x == 0) ||
+                    (style == HS_FDIAGONAL && x == y) || (style == HS_BDIAGONAL && x + y == 7) ||
+                    (style == HS_CROSS && (x == 0 || y == 0)) || (style == HS_DIAGCROSS && (x == y || x + y == 7));
+                tile[y * 8 + x] = on ? 0xFF000000u : 0u;
+            }
+        }
+        D2D1_BITMAP_PROPERTIES bp = {};
+        bp.pixelFormat.format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        bp.pixelFormat.alphaMode = D2D1_ALPHA_MODE_PREMULTIPLIED;
+        bp.dpiX = 96.0f;
+        bp.dpiY = 96.0f;
+        D2D1_SIZE_U size = { 8, 8 };
+        ID2D1Bitmap* bitmap = nullptr;
+        if (FAILED(target->CreateBitmap(size, tile, 8 * 4, &bp, &bitmap))) return nullptr;
+        D2D1_BITMAP_BRUSH_PROPERTIES wrap = { D2D1_EXTEND_MODE_WRAP, D2D1_EXTEND_MODE_WRAP, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR };
+        target->CreateBitmapBrush(bitmap, &wrap, nullptr, &brush);
+        bitmap->Release();
+        return brush;
+    }
+
+    IDWriteTextFormat* Format(int pixelSize, bool bold) {
+        int key = pixelSize << 1 | (bold ? 1 : 0);
+        IDWriteTextFormat*& format = formats[key];
+        if (!format && SUCCEEDED(dwrite->CreateTextFormat(L"Segoe UI", nullptr,
+                bold ? DWRITE_FONT_WEIGHT_BOLD : DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STYLE_NORMAL,
+                DWRITE_FONT_STRETCH_NORMAL, (FLOAT)pixelSize, L"cs-CZ", &format))) {
+            format->SetWordWrapping(DWRITE_WORD_WRAPPING_NO_WRAP);
+        }
+        return format;
+    }
+
+    // FNV-1a over raw bytes; keys the caches without building key strings
+    static uint64_t Hash(const void* data, size_t size, uint64_t h = 1469598103934665603ULL) {
+        const uint8_t* p = (const uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) h = (h ^ p[i]) * 1099511628211ULL;
+        return h;
+    }
+
+    // Layout of one label, keyed by (text, pixel size, weight). A hit costs
+    // a hash and a compare; labels that change with the data (values, live
+    // totals) eventually fill the cache, which then simply starts over.
+    IDWriteTextLayout* TextLayout(const wchar_t* text, size_t length, int pixelSize, bool bold) {
+        int style = pixelSize << 1 | (bold ? 1 : 0);
+        uint64_t key = Hash(text, length * sizeof(wchar_t), Hash(&style, sizeof(style)));
+        auto it = layouts.find(key);
+        if (it != layouts.end() && it->second.style == style &&
+            it->second.text.compare(0, std::wstring::npos, text, length) == 0) {
+            return it->second.layout;
+        }
+        IDWriteTextFormat* format = Format(pixelSize, bold);
+        if (!format) return nullptr;
+        IDWriteTextLayout* layout = nullptr;
+        if (FAILED(dwrite->CreateTextLayout(text, (UINT32)length, format, 4096.0f, 1024.0f, &layout))) return nullptr;
+        if (it != layouts.end()) {
+            // hash collision: the newer label takes the slot
+            it->second.layout->Release();
+            layouts.erase(it);
+        } else if (layouts.size() >= kMaxLayouts) {
+            ClearLayouts();
+        }
+        layouts.emplace(key, CachedLayout{ std::wstring(text, length), style, layout });
+        return layout;
+    }
+
+    void ClearLayouts() {
+        for (auto& kv : layouts) kv.second.layout->Release();
+        layouts.clear();
+    }
+
+    // Closed wedge from the center along the arc; device independent, so it
+    // survives a lost device
+    ID2D1PathGeometry* PieGeometry(const PieWedge& w) {
+        const PieKey shape = { w.cx, w.cy, w.radius, w.a0, w.a1 };
+        uint64_t key = Hash(&shape.cx, 3 * sizeof(int), Hash(&shape.a0, 2 * sizeof(double)));
+        auto it = pies.find(key);
+        if (it != pies.end() && it->second.shape == shape) return it->second.geometry;
+        if (it != pies.end()) {
+            it->second.geometry->Release();
+            pies.erase(it);
+        } else if (pies.size() >= kMaxPies) {
+            for (auto& kv : pies) kv.second.geometry->Release();
+            pies.clear();
+        }
+        ID2D1PathGeometry* path = nullptr;
+        ID2D1GeometrySink* sink = nullptr;
+        if (FAILED(factory->CreatePathGeometry(&path))) return nullptr;
+        bool ok = false;
+        if (SUCCEEDED(path->Open(&sink))) {
+            D2D1_POINT_2F center = { (FLOAT)w.cx, (FLOAT)w.cy };
+            D2D1_POINT_2F from = { (FLOAT)(w.cx + w.radius * w.cos0), (FLOAT)(w.cy + w.radius * w.sin0) };
+            D2D1_ARC_SEGMENT arc = {};
+            arc.point = { (FLOAT)(w.cx + w.radius * w.cos1), (FLOAT)(w.cy + w.radius * w.sin1) };
+            arc.size = { (FLOAT)w.radius, (FLOAT)w.radius };
+            arc.sweepDirection = D2D1_SWEEP_DIRECTION_CLOCKWISE;
+            arc.arcSize = w.a1 - w.a0 > 3.14159265358979323846 ? D2D1_ARC_SIZE_LARGE : D2D1_ARC_SIZE_SMALL;
+            sink->BeginFigure(center, D2D1_FIGURE_BEGIN_FILLED);
+            sink->AddLine(from);
+            sink->AddArc(&arc);
+            sink->EndFigure(D2D1_FIGURE_END_CLOSED);
+            ok = SUCCEEDED(sink->Close());
+            sink->Release();
+        }
+        if (!ok) {
+            path->Release();
+            return nullptr;
+        }
+        pies.emplace(key, CachedPie{ shape, path });
+        return path;
+    }
+
+    struct CachedLayout {
+        std::wstring text;
+        int style;
+        IDWriteTextLayout* layout;
+    };
+    struct PieKey {
+        int cx, cy, radius;
+        double a0, a1;
+        bool operator==(const PieKey& o) const { return cx == o.cx && cy == o.cy && radius == o.radius && a0 == o.a0 && a1 == o.a1; }
+    };
+    struct CachedPie {
+        PieKey shape;
+        ID2D1PathGeometry* geometry;
+    };
+
+    ID2D1Factory* factory = nullptr;
+    IDWriteFactory* dwrite = nullptr;
+    ID2D1DCRenderTarget* target = nullptr;
+    std::unordered_map<COLORREF, ID2D1SolidColorBrush*> solids;
+    ID2D1BitmapBrush* hatches[HS_DIAGCROSS + 1] = {};
+    std::unordered_map<int, IDWriteTextFormat*> formats;
+    std::unordered_map<uint64_t, CachedLayout> layouts;
+    std::unordered_map<uint64_t, CachedPie> pies;
+};
+static D2DRenderer g_d2d;
+#endif
+
+// Backend of the on-screen view, chosen on WM_CREATE: Direct2D unless
+// --renderer gdi is given or it cannot be initialized
+static bool g_useD2D = false;
+
+// Draw one section, timed as its own trace sample; draw picks another
+// instantiation than the on-screen one
+void drawSection(Renderer& r, int section, RECT& area, SectionDrawFn draw = nullptr) {
+    ER_TRACE_SCOPE((TraceId)(TraceSectionHeader + section));
+    (draw ? draw : kSections[section].draw)(r, area);
+}
+
+// Draw one section into the cached bitmap selected into dc
+void RenderSection(HDC dc, int section, RECT& area) {
+#if defined(ER_HAVE_D2D)
+    if (g_useD2D && g_d2d.Begin(dc, area)) {
+        drawSection(g_d2d, section, area);
+        if (g_d2d.End()) return;
+    }
+#endif
+    GdiRenderer gdi(dc);
+    drawSection(gdi, section, area);
+}
+
+// ---- Scroll view and section cache ----
+// The window stacks ReportDayCount() report pages below a fixed band with
+// the buttons. Every section is cached in its own bitmap; painting renders
+// only sections that intersect the paint rectangle and are missing or stale,
+// scrolling moves the pixels already on screen with ScrollWindowEx and
+// paints the exposed strip from the cache.
+struct SectionBitmap {
+    int day = 0;
+    int section = 0;
+    HBITMAP bitmap = NULL;
+    int width = 0;
+    int height = 0;
+    uint64_t version = 0;  // g_dayVersion the bitmap was rendered from
+    bool dirty = false;
+    uint64_t lastUse = 0;
+};
+
+// LRU of section bitmaps under a memory cap; a month at 4K still fits,
+// beyond that the sections farthest back in the scroll history are dropped
+class SectionCache {
+public:
+    static const size_t kMaxBytes = 192u << 20;
+
+    ~SectionCache() { Clear(); }
+
+    // Memory DC with an up-to-date bitmap of the section selected, sized
+    // width x height; renders it if it is missing, dirty or stale
+    HDC Acquire(HDC screen, int day, int section, int width, int height) {
+        if (!dc) dc = CreateCompatibleDC(screen);
+        SectionBitmap* entry = Find(day, section);
+        if (entry && (entry->width != width || entry->height != height)) {
+            Drop(entry);
+            entry = nullptr;
+        }
+        if (!entry) {
+            size_t need = (size_t)width * height * 4;
+            while (!entries.empty() && bytes + need > kMaxBytes) Drop(Oldest());
+            SectionBitmap fresh;
+            fresh.day = day;
+            fresh.section = section;
+            fresh.bitmap = CreateCompatibleBitmap(screen, width, height);
+            fresh.width = width;
+            fresh.height = height;
+            fresh.dirty = true;
+            if (!fresh.bitmap) return NULL;
+            entries.push_back(fresh);
+            bytes += need;
+            entry = &entries.back();
+        }
+        entry->lastUse = ++clock;
+        HGDIOBJ previous = SelectObject(dc, entry->bitmap);
+        if (!oldBitmap) oldBitmap = previous;
+        if (entry->dirty || entry->version != g_dayVersion) {
+            RECT area = { 0, 0, width, height };
+            FillRect(dc, &area, (HBRUSH)(COLOR_WINDOW + 1));
+            ScopedRenderBinding bind(&ReportDay(day), &g_gdi, &g_layout);
+            RenderSection(dc, section, area);
+            entry->dirty = false;
+            entry->version = g_dayVersion;
+        }
+        return dc;
+    }
+
+    void MarkDirty(int day, int section) {
+        if (SectionBitmap* entry = Find(day, section)) entry->dirty = true;
+    }
+
+    void Clear() {
+        if (dc) {
+            if (oldBitmap) SelectObject(dc, oldBitmap);
+            DeleteDC(dc);
+            dc = NULL;
+            oldBitmap = NULL;
+        }
+        for (SectionBitmap& e : entries) DeleteObject(e.bitmap);
+        entries.clear();
+        bytes = 0;
+    }
+
+private:
+    SectionBitmap* Find(int day, int section) {
+        for (SectionBitmap& e : entries)
+            if (e.day == day && e.section == section) return &e;
+        return nullptr;
+    }
+
+    SectionBitmap* Oldest() {
+        SectionBitmap* oldest = &entries.front();
+        for (SectionBitmap& e : entries)
+            if (e.lastUse < oldest->lastUse) oldest = &e;
+        return oldest;
+    }
+
+    void Drop(SectionBitmap* entry) {
+        // never delete a bitmap while it is selected into the DC
+        if (oldBitmap) SelectObject(dc, oldBitmap);
+        DeleteObject(entry->bitmap);
+        bytes -= (size_t)entry->width * entry->height * 4;
+        *entry = entries.back();
+        entries.pop_back();
+    }
+
+    HDC dc = NULL;
+    HGDIOBJ oldBitmap = NULL;
+    std::vector<SectionBitmap> entries;
+    size_t bytes = 0;
+    uint64_t clock = 0;
+};
+static SectionCache g_sectionCache;
+
+// Vertical scroll offset of the pages below the button band
+static int g_scrollY = 0;
+
+// The band with the buttons stays in place; pages scroll below it
+int BandHeight() { return g_layout.sections[0].top - g_layout.Px(10); }
+int PageHeight() { return g_layout.height - BandHeight(); }
+
+// Client rectangle of one section of one day at the current scroll offset
+RECT SectionClientRect(int day, int section) {
+    RECT r = g_layout.sections[section];
+    OffsetRect(&r, 0, day * PageHeight() - g_scrollY);
+    return r;
+}
+
+// Mark one section of the first day stale and repaint only its strip of the
+// window. Use this when a data update affects a single chart instead of
+// bumping g_dayVersion.
+void InvalidateSection(HWND hwnd, SectionId id) {
+    g_sectionCache.MarkDirty(0, id);
+    RECT r = SectionClientRect(0, id);
+    InvalidateRect(hwnd, &r, FALSE);
+}
+
+// Paint every section intersecting the paint rectangle, rendering those
+// that are not cached yet; the band and the gaps get the background
+void PaintReport(HDC hdc, const RECT& paint) {
+    const int band = BandHeight();
+    const int page = PageHeight();
+    SaveDC(hdc);
+    IntersectClipRect(hdc, paint.left, std::max<int>(paint.top, band), paint.right, paint.bottom);
+    // only the pages overlapping the paint rectangle are visited
+    int first = (std::max<int>(paint.top, band) - band + g_scrollY) / page;
+    for (int d = first; d < ReportDayCount() && d * page - g_scrollY + band < paint.bottom; ++d) {
+        for (int i = 0; i < SectionCount; ++i) {
+            RECT r = SectionClientRect(d, i), hit;
+            if (!IntersectRect(&hit, &r, &paint)) continue;
+            HDC src = g_sectionCache.Acquire(hdc, d, i, r.right - r.left, r.bottom - r.top);
+            if (!src) continue;
+            BitBlt(hdc, hit.left, hit.top, hit.right - hit.left, hit.bottom - hit.top,
+                src, hit.left - r.left, hit.top - r.top, SRCCOPY);
+            ExcludeClipRect(hdc, hit.left, hit.top, hit.right, hit.bottom);
+        }
+    }
+    // the clip region is now the gaps between the sections
+    FillRect(hdc, &paint, (HBRUSH)(COLOR_WINDOW + 1));
+    RestoreDC(hdc, -1);
+    RECT top = paint;
+    if (top.bottom > band) top.bottom = band;
+    if (top.bottom > top.top) FillRect(hdc, &top, (HBRUSH)(COLOR_WINDOW + 1));
+}
+
+// Height of the pages that do not fit below the band
+int MaxScroll(HWND hwnd) {
+    RECT client;
+    GetClientRect(hwnd, &client);
+    return std::max(0, ReportDayCount() * PageHeight() + g_layout.Px(10) - (int)(client.bottom - BandHeight()));
+}
+
+// Refresh the scroll bar range after a layout, size or day count change
+void UpdateScrollBar(HWND hwnd) {
+    RECT client;
+    GetClientRect(hwnd, &client);
+    g_scrollY = std::min(g_scrollY, MaxScroll(hwnd));
+    SCROLLINFO si = {};
+    si.cbSize = sizeof(si);
+    si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
+    si.nMin = 0;
+    si.nMax = ReportDayCount() * PageHeight() + g_layout.Px(10) - 1;
+    si.nPage = (UINT)std::max(0, (int)client.bottom - BandHeight());
+    si.nPos = g_scrollY;
+    SetScrollInfo(hwnd, SB_VERT, &si, TRUE);
+}
+
+#if ENERGY_REPORT_TRACE
+void InvalidateOverlay(HWND hwnd);
+#endif
+
+// Scroll the pages to offset y: the pixels on screen move, only the exposed
+// strip is painted (right away, so dragging the thumb stays smooth)
+void ScrollReportTo(HWND hwnd, int y) {
+    y = std::max(0, std::min(y, MaxScroll(hwnd)));
+    if (y == g_scrollY) return;
+    int dy = g_scrollY - y;
+    g_scrollY = y;
+    RECT view;
+    GetClientRect(hwnd, &view);
+    view.top = BandHeight();
+    ScrollWindowEx(hwnd, 0, dy, &view, &view, NULL, NULL, SW_INVALIDATE);
+#if ENERGY_REPORT_TRACE
+    // the overlay stays put while the pages move under it
+    InvalidateOverlay(hwnd);
+#endif
+    SetScrollPos(hwnd, SB_VERT, y, TRUE);
+    UpdateWindow(hwnd);
+}
+
+// ---- Live meter streaming ----
+// --live follows meter readings while the window is open. A reader thread
+// pushes samples into a single-producer/single-consumer ring and posts
+// WM_APP_LIVE_DATA, at most liveRate times per second and never while a
+// previous notification is still pending. The UI thread drains the ring into
+// g_day: within an hour only the line chart and header are repainted, a new
+// hour refreshes every section and a new date starts a new day.
+enum { WM_APP_LIVE_DATA = WM_APP + 3 };
+
+// Lock-free ring between exactly one producer and one consumer thread
+template <typename T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+public:
+    bool TryPush(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        items[t & (N - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool TryPop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        value = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    bool Empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+private:
+    T items[N];
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
+
+// One meter reading: consumption of the interval starting at 'minute'
+struct LiveSample {
+    int64_t day;    // days since 1970-01-01
+    int minute;     // minute of day
+    double kWh;
+};
+
+class LiveMeter {
+public:
+    // source: path of a meter CSV that keeps growing, or "sim"
+    bool Start(HWND hwnd, const std::wstring& src, uint32_t rate) {
+        if (thread) return true;
+        notify = hwnd;
+        source = src;
+        minIntervalMs = 1000 / std::max(1u, rate);
+        stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        thread = stopEvent ? CreateThread(NULL, 0, ThreadMain, this, 0, NULL) : NULL;
+        return thread != NULL;
+    }
+
+    void Stop() {
+        if (!thread) return;
+        SetEvent(stopEvent);
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+        CloseHandle(stopEvent);
+        thread = stopEvent = NULL;
+    }
+
+    // UI thread, on WM_APP_LIVE_DATA: apply every queued sample to g_day
+    void Drain(HWND hwnd) {
+        posted = false;
+        bool changed = false, newHour = false, newDay = false;
+        LiveSample sample;
+        while (ring.TryPop(sample)) {
+            if (sample.minute < 0 || sample.minute >= 1440 || !(sample.kWh >= 0.0)) continue;
+            if (sample.day != liveDay) {
+                StartDay(sample.day);
+                newDay = true;
+            }
+            int hour = sample.minute / 60;
+            if (!(g_day.hourMask & (1u << hour))) {
+                g_day.hourMask |= 1u << hour;
+                newHour = true;
+            }
+            updateHourlySample(g_day, liveHourly, hour, g_day.hourlyKWh[hour] + sample.kWh);
+            changed = true;
+        }
+        if (!changed) return;
+        ++g_dayRevision;
+        if (newDay) {
+            ++g_dayVersion;
+            InvalidateRect(hwnd, NULL, FALSE);
+        } else if (newHour) {
+            // the shares and the table/checklist follow the hour, not every sample
+            fillBreakdown(g_day);
+            for (int i = 0; i < SectionCount; ++i) InvalidateSection(hwnd, (SectionId)i);
+        } else {
+            InvalidateSection(hwnd, SectionLine);
+            InvalidateSection(hwnd, SectionHeader);
+        }
+    }
+
+private:
+    static DWORD WINAPI ThreadMain(LPVOID self) {
+        LiveMeter* meter = (LiveMeter*)self;
+        if (meter->source == L"sim") meter->RunSimulated();
+        else meter->RunFile();
+        return 0;
+    }
+
+    bool Stopping(DWORD waitMs = 0) const { return WaitForSingleObject(stopEvent, waitMs) == WAIT_OBJECT_0; }
+
+    // Replace g_day with an empty, writable day (samples never alias a store)
+    void StartDay(int64_t day) {
+        EnergyDay fresh;
+        fresh.buildingName = g_day.buildingName;
+        fresh.priceCZKPerKWh = g_day.priceCZKPerKWh;
+        fresh.date = civilFromDays(day);
+        liveHourly = SampleBuffer::Allocate(24);
+        fresh.hourlyKWh = liveHourly;
+        fresh.samples = fresh.hourlyKWh;
+        fresh.hourMask = 0;
+        computeEnergyStats(fresh);
+        fillBreakdown(fresh);
+        g_day = fresh;
+        liveDay = day;
+    }
+
+    // Post WM_APP_LIVE_DATA unless one is pending or the last one was too recent
+    void MaybeNotify() {
+        if (ring.Empty()) return;
+        DWORD now = GetTickCount();
+        if (now - lastPost < minIntervalMs || posted.exchange(true)) return;
+        lastPost = now;
+        if (!PostMessage(notify, WM_APP_LIVE_DATA, 0, 0)) posted = false;
+    }
+
+    // Block while the ring is full (the UI is behind), unless stopping
+    bool Push(const LiveSample& sample) {
+        while (!ring.TryPush(sample)) {
+            MaybeNotify();
+            if (Stopping(5)) return false;
+        }
+        return true;
+    }
+
+    // Read the CSV from the start, then keep polling for appended rows
+    void RunFile() {
+        HANDLE file = CreateFileW(source.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return;
+        std::vector<uint8_t> buffer;
+        size_t pending = 0; // bytes of an incomplete last line kept at the front
+        while (!Stopping()) {
+            buffer.resize(pending + 64 * 1024);
+            DWORD n = 0;
+            if (!ReadFile(file, buffer.data() + pending, 64 * 1024, &n, NULL) || n == 0) {
+                MaybeNotify();
+                if (Stopping(100)) break;
+                continue;
+            }
+            size_t size = pending + n;
+            size_t complete = size;
+            while (complete > 0 && buffer[complete - 1] != '\n') --complete;
+            MeterCsvReader reader(buffer.data(), complete);
+            LiveSample sample;
+            while (reader.NextLine()) {
+                if (reader.ParseRow(sample.day, sample.minute, sample.kWh) && !Push(sample)) break;
+            }
+            pending = size - complete;
+            memmove(buffer.data(), buffer.data() + complete, pending);
+            MaybeNotify();
+        }
+        CloseHandle(file);
+    }
+
+    // A meter replaying simulated days in accelerated time, one minute of
+    // readings every 50 ms (a day in 72 s), for demos on the lobby display
+    void RunSimulated() {
+        SYSTEMTIME now;
+        GetLocalTime(&now);
+        int64_t day = daysFromCivil(now.wYear, now.wMonth, now.wDay);
+        SeededRNG noise(g_options.seed ^ 0x5EEDULL);
+        while (!Stopping()) {
+            EnergyDay profile = simulateEnergyDay(g_options.seed + (uint64_t)day);
+            for (int minute = 0; minute < 1440 && !Stopping(minute ? 50 : 0); ++minute) {
+                double kWh = profile.hourlyKWh[minute / 60] / 60.0 * (0.8 + 0.4 * noise.nextDouble01());
+                if (!Push({ day, minute, kWh })) return;
+                MaybeNotify();
+            }
+            ++day;
+        }
+    }
+
+    SpscRing<LiveSample, 4096> ring;
+    HWND notify = NULL;
+    std::wstring source;
+    DWORD minIntervalMs = 250;
+    DWORD lastPost = 0;        // reader thread only
+    std::atomic<bool> posted{ false };
+    HANDLE thread = NULL;
+    HANDLE stopEvent = NULL;
+    int64_t liveDay = INT64_MIN; // UI thread only
+    SampleBuffer liveHourly;     // writable buffer behind g_day.hourlyKWh, UI thread only
+};
+static LiveMeter g_live;
+
+// ---- ESC/POS raster pipeline ----
+// How the 32-bpp rendering is reduced to printer dots
+enum DitherMode {
+    DitherThreshold,      // luma < threshold
+    DitherOrdered,        // 4x4 Bayer matrix around the threshold, as in the JS version
+    DitherFloydSteinberg  // error diffusion
+};
+
+// How raster rows are sent to the printer
+enum RasterCodec {
+    RasterGsv0,     // GS v 0 bands; repeated row pairs use the double-height mode
+    RasterPackBits  // Star graphic mode: one PackBits (TIFF) compressed row per "b n1 n2" command
+};
+
+// Thermal printer geometry. Sections are rendered at the full printable width
+// and sent as raster bands separated by ESC d paper feeds, like the JS version
+// does. Blank rows are never sent; they become ESC J feeds of one dot each, so
+// the motion unit is assumed to be one dot row (203 dpi printers).
+struct PrinterProfile {
+    const wchar_t* name;
+    int dots;                 // printable width in dots
+    int feedBetweenSections;  // ESC d lines after each section
+    int feedEnd;              // ESC d lines after the report
+    int maxBandRows;          // rows per GS v 0 command, bounded by small printer buffers
+    DitherMode dither;
+    int threshold;            // luma 0..255 below which a dot is printed
+    RasterCodec codec;
+    const SectionDrawFn* draw; // Draw* instantiated for this paper width
+};
+static const PrinterProfile kPrinter58mm = { L"58 mm", 384, 12, 40, 255, DitherOrdered, 160, RasterGsv0, PaperSections<384>::draw };
+static const PrinterProfile kPrinter80mm = { L"80 mm", 576, 12, 40, 255, DitherOrdered, 160, RasterGsv0, PaperSections<576>::draw };
+static const PrinterProfile kPrinterStar80mm = { L"80 mm Star", 576, 12, 40, 255, DitherOrdered, 160, RasterPackBits, PaperSections<576>::draw };
+
+// Profile selected with --printer-profile; 58 mm for anything else
+const PrinterProfile& printProfile(const AppOptions& opts) {
+    if (opts.printerProfile == L"80mm") return kPrinter80mm;
+    if (opts.printerProfile == L"star80mm") return kPrinterStar80mm;
+    return kPrinter58mm;
+}
+
+// Conversion selected with --dither; the profile's own for anything else
+DitherMode printDither(const AppOptions& opts, const PrinterProfile& profile) {
+    if (opts.dither == L"threshold") return DitherThreshold;
+    if (opts.dither == L"ordered") return DitherOrdered;
+    if (opts.dither == L"fs") return DitherFloydSteinberg;
+    return profile.dither;
+}
+
+// 32-bpp top-down DIB section the print sections are rendered into. Gray
+// grid lines, hatch patterns and antialiased text survive here and are
+// reduced to dots by convertToMono().
+class ColorRaster {
+public:
+    ~ColorRaster() { Release(); }
+    bool Resize(int w, int h) {
+        if (dc && w == width && h <= capacity) {
+            height = h;
+            return true;
+        }
+        Release();
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = w;
+        bmi.bmiHeader.biHeight = -h; // top-down
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        dc = CreateCompatibleDC(NULL);
+        void* pixels = nullptr;
+        bitmap = CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, &pixels, NULL, 0);
+        if (!dc || !bitmap) {
+            Release();
+            return false;
+        }
+        oldBitmap = SelectObject(dc, bitmap);
+        bits = (uint32_t*)pixels;
+        width = w;
+        height = capacity = h;
+        return true;
+    }
+    void Clear() { memset(bits, 0xFF, (size_t)width * height * 4); }
+    HDC Dc() const { return dc; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    const uint32_t* Row(int y) const { return bits + (size_t)width * y; }
+private:
+    void Release() {
+        if (dc) {
+            SelectObject(dc, oldBitmap);
+            DeleteDC(dc);
+        }
+        if (bitmap) DeleteObject(bitmap);
+        dc = NULL;
+        bitmap = NULL;
+        bits = nullptr;
+        width = height = capacity = 0;
+    }
+    HDC dc = NULL;
+    HBITMAP bitmap = NULL;
+    HGDIOBJ oldBitmap = NULL;
+    uint32_t* bits = nullptr;
+    int width = 0, height = 0, capacity = 0;
+};
+
+// Packed 1-bpp rows in ESC/POS order: MSB is the leftmost dot, a set bit is
+// a printed dot. Buffer capacity is kept between jobs.
+struct PackedRaster {
+    int width = 0;
+    int height = 0;
+    int widthBytes = 0;
+    std::vector<uint8_t> bits;
+    void Resize(int w, int h) {
+        width = w;
+        height = h;
+        widthBytes = (w + 7) / 8;
+        bits.resize((size_t)widthBytes * h);
+    }
+    uint8_t* Row(int y) { return bits.data() + (size_t)widthBytes * y; }
+    const uint8_t* Row(int y) const { return bits.data() + (size_t)widthBytes * y; }
+};
+
+// ---- Mono conversion kernels ----
+// Luma uses integer weights summing to 256 so every kernel computes exactly
+// the same value: (77 R + 150 G + 29 B) >> 8. A dot is printed when the luma
+// is below the threshold of its column; the threshold and ordered modes only
+// differ in the 8-entry threshold row, so one branch-free row kernel covers
+// both. The SIMD kernels produce one output byte per 8 pixels from a movemask
+// and are bit-identical to the scalar one.
+static const uint8_t kBayer4x4[4][4] = {
+    { 0, 8, 2, 10 },
+    { 12, 4, 14, 6 },
+    { 3, 11, 1, 9 },
+    { 15, 7, 13, 5 }
+};
+
+// Bit order reversal of a byte: movemask yields pixel 0 in bit 0, ESC/POS wants it in bit 7
+struct BitReverseTable {
+    uint8_t v[256];
+    constexpr BitReverseTable() : v() {
+        for (int i = 0; i < 256; ++i) {
+            int r = 0;
+            for (int b = 0; b < 8; ++b) r |= ((i >> b) & 1) << (7 - b);
+            v[i] = (uint8_t)r;
+        }
+    }
+};
+static constexpr BitReverseTable kBitReverse;
+
+inline int lumaOf(uint32_t p) {
+    return (int)((((p >> 16) & 0xFF) * 77 + ((p >> 8) & 0xFF) * 150 + (p & 0xFF) * 29) >> 8);
+}
+
+// Threshold of the 8 dots in every byte of row y
+void thresholdRow(DitherMode mode, int threshold, int y, int32_t thr[8]) {
+    for (int i = 0; i < 8; ++i) {
+        thr[i] = mode == DitherOrdered ? threshold + kBayer4x4[y & 3][i & 3] * 8 - 48 : threshold;
+    }
+}
+
+// Scalar reference; x0 is the first pixel, a multiple of 8
+void packRowScalar(const uint32_t* px, int x0, int width, const int32_t thr[8], uint8_t* out) {
+    for (int x = x0; x < width; x += 8) {
+        unsigned byte = 0;
+        int n = std::min(8, width - x);
+        for (int i = 0; i < n; ++i) byte |= (unsigned)(lumaOf(px[x + i]) < thr[i]) << (7 - i);
+        out[x / 8] = (uint8_t)byte;
+    }
+}
+
+#if defined(ER_HAVE_X86_SIMD)
+ER_TARGET_SSE2 inline __m128i lumaSse2(__m128i v) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i b = _mm_and_si128(v, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    // products fit in the low 16 bits of each 32-bit lane, the high halves stay zero
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(77)),
+        _mm_mullo_epi16(g, _mm_set1_epi32(150))), _mm_mullo_epi16(b, _mm_set1_epi32(29)));
+    return _mm_srli_epi32(sum, 8);
+}
+
+// Returns the number of fully converted pixels (a multiple of 8)
+ER_TARGET_SSE2 int packRowSse2(const uint32_t* px, int width, const int32_t thr[8], uint8_t* out) {
+    const __m128i t0 = _mm_loadu_si128((const __m128i*)thr);
+    const __m128i t1 = _mm_loadu_si128((const __m128i*)(thr + 4));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i l0 = lumaSse2(_mm_loadu_si128((const __m128i*)(px + x)));
+        __m128i l1 = lumaSse2(_mm_loadu_si128((const __m128i*)(px + x + 4)));
+        int lo = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(l0, t0)));
+        int hi = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(l1, t1)));
+        out[x / 8] = kBitReverse.v[lo | (hi << 4)];
+    }
+    return x;
+}
+
+ER_TARGET_AVX2 int packRowAvx2(const uint32_t* px, int width, const int32_t thr[8], uint8_t* out) {
+    const __m256i t = _mm256_loadu_si256((const __m256i*)thr);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256i wr = _mm256_set1_epi32(77), wg = _mm256_set1_epi32(150), wb = _mm256_set1_epi32(29);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(px + x));
+        __m256i b = _mm256_and_si256(v, mask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+        __m256i luma = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi16(r, wr),
+            _mm256_mullo_epi16(g, wg)), _mm256_mullo_epi16(b, wb)), 8);
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t, luma)));
+        out[x / 8] = kBitReverse.v[bits];
+    }
+    return x;
+}
+#endif
+
+// Threshold/ordered conversion of one row with the best available kernel
+void packRow(const uint32_t* px, int width, const int32_t thr[8], uint8_t* out) {
+    int done = 0;
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) done = packRowAvx2(px, width, thr, out);
+    else if (cpuHasSse2()) done = packRowSse2(px, width, thr, out);
+#endif
+    packRowScalar(px, done, width, thr, out);
+}
+
+// Floyd-Steinberg error diffusion; inherently sequential, so scalar only.
+// err holds two rows of width + 2 accumulated errors (1 pixel border each side).
+void packRowFloydSteinberg(const uint32_t* px, int width, int threshold, int* errCur, int* errNext, uint8_t* out) {
+    memset(out, 0, (size_t)(width + 7) / 8);
+    for (int x = 0; x < width; ++x) {
+        int v = lumaOf(px[x]) + errCur[x + 1] / 16;
+        int dot = v < threshold;
+        int e = v - (dot ? 0 : 255);
+        out[x >> 3] |= (uint8_t)(dot << (7 - (x & 7)));
+        errCur[x + 2] += e * 7;
+        errNext[x] += e * 3;
+        errNext[x + 1] += e * 5;
+        errNext[x + 2] += e;
+    }
+}
+
+// Convert the first 'rows' rows of src into dst with the selected mode
+void convertToMono(const ColorRaster& src, int rows, DitherMode mode, int threshold, PackedRaster& dst) {
+    dst.Resize(src.Width(), rows);
+    if (mode == DitherFloydSteinberg) {
+        std::vector<int> err((size_t)(src.Width() + 2) * 2, 0);
+        int* cur = err.data();
+        int* next = cur + src.Width() + 2;
+        for (int y = 0; y < rows; ++y) {
+            packRowFloydSteinberg(src.Row(y), src.Width(), threshold, cur, next, dst.Row(y));
+            std::swap(cur, next);
+            memset(next, 0, (size_t)(src.Width() + 2) * sizeof(int));
+        }
+        return;
+    }
+    int32_t thr[8];
+    for (int y = 0; y < rows; ++y) {
+        thresholdRow(mode, threshold, y, thr);
+        packRow(src.Row(y), src.Width(), thr, dst.Row(y));
+    }
+}
+
+void escposInit(std::vector<uint8_t>& out) {
+    out.push_back(0x1B);
+    out.push_back(0x40);
+}
+
+void escposFeedLines(std::vector<uint8_t>& out, int lines) {
+    out.push_back(0x1B);
+    out.push_back(0x64);
+    out.push_back((uint8_t)std::min(lines, 255));
+}
+
+// Byte counts of one encoded report, to show what the row encoder saved
+struct RasterStats {
+    size_t plainBytes = 0;    // the same rows as plain GS v 0 bands
+    size_t encodedBytes = 0;  // what was actually emitted for them
+    int blankRows = 0;        // replaced by paper feeds
+    int repeatedRows = 0;     // sent once and printed twice (or delta/packed away)
+    int textSections = 0;     // sections sent as printer text instead of raster
+    size_t textBytes = 0;
+    size_t Saved() const { return plainBytes > encodedBytes ? plainBytes - encodedBytes : 0; }
+};
+
+bool rowIsBlank(const uint8_t* row, int widthBytes) {
+    for (int i = 0; i < widthBytes; ++i) {
+        if (row[i]) return false;
+    }
+    return true;
+}
+
+// Feed n dot rows without printing (ESC J, one unit per dot row)
+void escposFeedDots(std::vector<uint8_t>& out, int dots) {
+    for (; dots > 0; dots -= 255) {
+        out.push_back(0x1B);
+        out.push_back(0x4A);
+        out.push_back((uint8_t)std::min(dots, 255));
+    }
+}
+
+// GS v 0 band of 'rows' data rows taken from every 'step'-th raster row.
+// Double height (m = 2) prints each data row twice.
+void escposBand(std::vector<uint8_t>& out, const PackedRaster& raster, int y, int rows, bool doubleHeight) {
+    const int widthBytes = raster.widthBytes;
+    const uint8_t header[8] = { 0x1D, 0x76, 0x30, (uint8_t)(doubleHeight ? 2 : 0),
+        (uint8_t)(widthBytes & 0xFF), (uint8_t)(widthBytes >> 8), (uint8_t)(rows & 0xFF), (uint8_t)(rows >> 8) };
+    out.insert(out.end(), header, header + sizeof(header));
+    const int step = doubleHeight ? 2 : 1;
+    for (int i = 0; i < rows; ++i) out.insert(out.end(), raster.Row(y + i * step), raster.Row(y + i * step) + widthBytes);
+}
+
+// Append rows [y0, y1) of a packed raster as GS v 0 bands. Runs of blank
+// rows become paper feeds, and runs of identical row pairs (box borders, bar
+// bodies, table rules) go out once in double-height bands.
+void escposRaster(std::vector<uint8_t>& out, const PackedRaster& raster, int y0, int y1, int maxBandRows, RasterStats& stats) {
+    const int widthBytes = raster.widthBytes;
+    const size_t start = out.size();
+    auto same = [&](int a, int b) { return memcmp(raster.Row(a), raster.Row(b), widthBytes) == 0; };
+    int y = y0;
+    while (y < y1) {
+        if (rowIsBlank(raster.Row(y), widthBytes)) {
+            int end = y + 1;
+            while (end < y1 && rowIsBlank(raster.Row(end), widthBytes)) ++end;
+            escposFeedDots(out, end - y);
+            stats.blankRows += end - y;
+            y = end;
+            continue;
+        }
+        // classify the rows ahead: pairs of identical rows vs. anything else
+        bool paired = y + 1 < y1 && same(y, y + 1);
+        int end = y;
+        while (end < y1 && (end - y) / (paired ? 2 : 1) < maxBandRows && !rowIsBlank(raster.Row(end), widthBytes)) {
+            bool pair = end + 1 < y1 && same(end, end + 1);
+            if (pair != paired) break;
+            end += paired ? 2 : 1;
+        }
+        escposBand(out, raster, y, (end - y) / (paired ? 2 : 1), paired);
+        if (paired) stats.repeatedRows += (end - y) / 2;
+        y = end;
+    }
+    stats.plainBytes += (size_t)(y1 - y0) * widthBytes + 8 * (size_t)((y1 - y0 + maxBandRows - 1) / maxBandRows);
+    stats.encodedBytes += out.size() - start;
+}
+
+// PackBits (TIFF) run-length encoding of one row
+void packBitsRow(const uint8_t* row, int n, std::vector<uint8_t>& out) {
+    int i = 0;
+    while (i < n) {
+        int run = 1;
+        while (i + run < n && run < 128 && row[i + run] == row[i]) ++run;
+        if (run >= 2) {
+            out.push_back((uint8_t)(1 - run));
+            out.push_back(row[i]);
+            i += run;
+            continue;
+        }
+        // literal bytes until the next run of three or more
+        int lit = 0;
+        while (i + lit < n && lit < 128) {
+            if (i + lit + 2 < n && row[i + lit] == row[i + lit + 1] && row[i + lit] == row[i + lit + 2]) break;
+            ++lit;
+        }
+        out.push_back((uint8_t)(lit - 1));
+        out.insert(out.end(), row + i, row + i + lit);
+        i += lit;
+    }
+}
+
+// Append rows [y0, y1) in Star graphic mode: ESC * r A enters raster mode,
+// each row is "b n1 n2" plus PackBits data, blank rows are skipped with
+// ESC * r Y n NUL and ESC * r B returns to text mode.
+void escposRasterPackBits(std::vector<uint8_t>& out, const PackedRaster& raster, int y0, int y1, RasterStats& stats) {
+    const int widthBytes = raster.widthBytes;
+    const size_t start = out.size();
+    const uint8_t enter[4] = { 0x1B, 0x2A, 0x72, 0x41 };
+    out.insert(out.end(), enter, enter + sizeof(enter));
+    std::vector<uint8_t> packed;
+    int y = y0;
+    while (y < y1) {
+        if (rowIsBlank(raster.Row(y), widthBytes)) {
+            int end = y + 1;
+            while (end < y1 && rowIsBlank(raster.Row(end), widthBytes)) ++end;
+            stats.blankRows += end - y;
+            char move[16];
+            int len = snprintf(move, sizeof(move), "\x1B*rY%d", end - y);
+            out.insert(out.end(), move, move + len);
+            out.push_back(0x00);
+            y = end;
+            continue;
+        }
+        if (y > y0 && memcmp(raster.Row(y), raster.Row(y - 1), widthBytes) == 0) stats.repeatedRows++;
+        packed.clear();
+        packBitsRow(raster.Row(y), widthBytes, packed);
+        out.push_back('b');
+        out.push_back((uint8_t)(packed.size() & 0xFF));
+        out.push_back((uint8_t)(packed.size() >> 8));
+        out.insert(out.end(), packed.begin(), packed.end());
+        ++y;
+    }
+    const uint8_t quit[4] = { 0x1B, 0x2A, 0x72, 0x42 };
+    out.insert(out.end(), quit, quit + sizeof(quit));
+    stats.plainBytes += (size_t)(y1 - y0) * widthBytes + 8;
+    stats.encodedBytes += out.size() - start;
+}
+
+// ---- ESC/POS text mode ----
+// Font A cells are 12 dots wide, so a 58 mm printer fits 32 characters.
+static const int kFontADots = 12;
+static const uint8_t kEscPosCodePage852 = 18; // ESC t value of CP852 (Latin 2)
+
+void escposCodePage852(std::vector<uint8_t>& out) {
+    out.push_back(0x1B);
+    out.push_back(0x74);
+    out.push_back(kEscPosCodePage852);
+}
+
+// bold: ESC E, large: GS ! double width and height
+void escposTextStyle(std::vector<uint8_t>& out, bool bold, bool large) {
+    const uint8_t style[6] = { 0x1B, 0x45, (uint8_t)(bold ? 1 : 0), 0x1D, 0x21, (uint8_t)(large ? 0x11 : 0x00) };
+    out.insert(out.end(), style, style + sizeof(style));
+}
+
+// Append text in CP852, wrapped at spaces to 'columns' characters per line
+void escposTextLine(std::vector<uint8_t>& out, const std::wstring& text, int columns, bool bold = false, bool large = false) {
+    if (large) columns /= 2;
+    escposTextStyle(out, bold, large);
+    size_t start = 0;
+    do {
+        size_t end = std::min(text.size(), start + (size_t)columns);
+        if (end < text.size()) {
+            size_t space = text.rfind(L' ', end);
+            if (space != std::wstring::npos && space > start) end = space;
+        }
+        int len = (int)(end - start);
+        if (len > 0) {
+            size_t at = out.size();
+            out.resize(at + len * 2);
+            int n = WideCharToMultiByte(852, 0, text.data() + start, len, (LPSTR)out.data() + at, len * 2, "?", NULL);
+            out.resize(at + std::max(n, 0));
+        }
+        out.push_back('\n');
+        start = end;
+        while (start < text.size() && text[start] == L' ') ++start;
+    } while (start < text.size());
+    if (bold || large) escposTextStyle(out, false, false);
+}
+
+void escposTextRule(std::vector<uint8_t>& out, int columns, wchar_t c = L'-') {
+    escposTextLine(out, std::wstring(columns, c), columns);
+}
+
+int textColumns(const PrinterProfile& profile) { return profile.dots / kFontADots; }
+
+// ---- Report templates ----
+// A print job is an EscPosDocument: byte ranges of its own interleaved with
+// shared blocks spliced in from a template, handed to the transport as a
+// gather list so nothing is copied into one contiguous stream. The template
+// of a profile and dither mode holds the title band (rows above kTitleRows)
+// of every section, encoded once in both raster and text form; a job only
+// renders, dithers and encodes what lies below it. ESC/POS raster bands are
+// always full width, so everything static that shares rows with data
+// (table headers, the legend frame) is simply part of the body.
+struct GatherBuffer {
+    const uint8_t* data;
+    size_t size;
+};
+
+class EscPosDocument {
+public:
+    // drops the parts, keeps the capacity of the own bytes
+    void Clear() {
+        own.clear();
+        parts.clear();
+        blocks.clear();
+        openAt = 0;
+        spliced = 0;
+    }
+    // append the job's own bytes here
+    std::vector<uint8_t>& Bytes() { return own; }
+    void Splice(std::shared_ptr<const std::vector<uint8_t>> block) {
+        Cut();
+        if (!block || block->empty()) return;
+        spliced += block->size();
+        parts.push_back({ (int)blocks.size(), 0, block->size() });
+        blocks.push_back(std::move(block));
+    }
+    // close the last own range; call once the build is done
+    void Finish() { Cut(); }
+    size_t Size() const { return own.size() + spliced; }
+    // valid while the document is alive and unchanged
+    void Buffers(std::vector<GatherBuffer>& out) const {
+        out.clear();
+        for (const Part& p : parts) {
+            const uint8_t* base = p.block < 0 ? own.data() : blocks[p.block]->data();
+            out.push_back({ base + p.offset, p.size });
+        }
+    }
+    // one contiguous stream, for callers that write a file themselves
+    void Flatten(std::vector<uint8_t>& out) const {
+        out.clear();
+        out.reserve(Size());
+        for (const Part& p : parts) {
+            const uint8_t* base = p.block < 0 ? own.data() : blocks[p.block]->data();
+            out.insert(out.end(), base + p.offset, base + p.offset + p.size);
+        }
+    }
+private:
+    struct Part {
+        int block;     // index into blocks, -1: own bytes
+        size_t offset;
+        size_t size;
+    };
+    void Cut() {
+        if (own.size() > openAt) parts.push_back({ -1, openAt, own.size() - openAt });
+        openAt = own.size();
+    }
+    std::vector<uint8_t> own;
+    std::vector<Part> parts;
+    std::vector<std::shared_ptr<const std::vector<uint8_t>>> blocks;
+    size_t openAt = 0;   // start of the own range not yet in parts
+    size_t spliced = 0;
+};
+
+// Title bands of every section for one profile and dither mode
+struct EscPosTemplate {
+    const PrinterProfile* profile;
+    DitherMode dither;
+    std::shared_ptr<const std::vector<uint8_t>> rasterTitle[SectionCount];
+    RasterStats rasterTitleStats[SectionCount];
+    std::shared_ptr<const std::vector<uint8_t>> textTitle[SectionCount];
+};
+
+// Render targets and templates reused by every job built on one thread
+struct PrintRasters {
+    ColorRaster color;
+    PackedRaster mono;
+    std::vector<std::unique_ptr<EscPosTemplate>> templates;
+    EscPosDocument document; // scratch of BuildEscPosReport
+};
+
+void encodeRows(const PrinterProfile& profile, const PackedRaster& mono, int rows, std::vector<uint8_t>& out, RasterStats& stats) {
+    if (profile.codec == RasterPackBits) escposRasterPackBits(out, mono, 0, rows, stats);
+    else escposRaster(out, mono, 0, rows, profile.maxBandRows, stats);
+}
+
+// Template of profile/dither, compiled on first use. Compiling renders every
+// section once, so it needs a bound day like the build itself; the title
+// band does not depend on it. color must already be kMaxSectionHeight tall.
+const EscPosTemplate& escposTemplate(const PrinterProfile& profile, DitherMode dither, PrintRasters& rasters) {
+    for (const std::unique_ptr<EscPosTemplate>& t : rasters.templates) {
+        if (t->profile == &profile && t->dither == dither) return *t;
+    }
+    std::unique_ptr<EscPosTemplate> t(new EscPosTemplate());
+    t->profile = &profile;
+    t->dither = dither;
+    for (int section = 0; section < SectionCount; ++section) {
+        rasters.color.Clear();
+        RECT area = { 0, 0, profile.dots, kSections[section].height };
+        GdiRenderer gdi(rasters.color.Dc());
+        drawSection(gdi, section, area, profile.draw[section]);
+        GdiFlush();
+        convertToMono(rasters.color, kTitleRows, dither, profile.threshold, rasters.mono);
+        std::shared_ptr<std::vector<uint8_t>> raster = std::make_shared<std::vector<uint8_t>>();
+        encodeRows(profile, rasters.mono, kTitleRows, *raster, t->rasterTitleStats[section]);
+        t->rasterTitle[section] = raster;
+        std::shared_ptr<std::vector<uint8_t>> text = std::make_shared<std::vector<uint8_t>>();
+        PrintSectionTitleText(profile, section, *text);
+        t->textTitle[section] = text;
+    }
+    rasters.templates.push_back(std::move(t));
+    return *rasters.templates.back();
+}
+
+void addRasterStats(RasterStats& to, const RasterStats& from) {
+    to.plainBytes += from.plainBytes;
+    to.encodedBytes += from.encodedBytes;
+    to.blankRows += from.blankRows;
+    to.repeatedRows += from.repeatedRows;
+}
+
+// Build the report into doc from the profile's template plus every section
+// body rendered at the printer width, converted to dots and encoded. Uses
+// the day and GDI cache bound to the calling thread. With hybridText, the
+// sections that have a text version are sent in printer fonts instead.
+// Returns false when the build failed or was cancelled (checked between
+// sections).
+bool BuildEscPosDocument(const PrinterProfile& profile, DitherMode dither, bool hybridText, PrintRasters& rasters,
+    EscPosDocument& doc, RasterStats& stats, const std::atomic<bool>* cancel = nullptr) {
+    doc.Clear();
+    stats = RasterStats();
+    if (!rasters.color.Resize(profile.dots, kMaxSectionHeight)) return false;
+    const EscPosTemplate& tmpl = escposTemplate(profile, dither, rasters);
+    escposInit(doc.Bytes());
+    if (hybridText) escposCodePage852(doc.Bytes());
+    for (const SectionInfo& info : kSections) {
+        if (cancel && *cancel) return false;
+        const int section = (int)(&info - kSections);
+        std::vector<uint8_t>& out = doc.Bytes();
+        if (hybridText && info.printText) {
+            doc.Splice(tmpl.textTitle[section]);
+            size_t at = out.size();
+            info.printText(profile, out);
+            stats.textSections++;
+            stats.textBytes += tmpl.textTitle[section]->size() + out.size() - at;
+            escposFeedLines(out, profile.feedBetweenSections);
+            continue;
+        }
+        doc.Splice(tmpl.rasterTitle[section]);
+        addRasterStats(stats, tmpl.rasterTitleStats[section]);
+        // the body alone: the section drawn kTitleRows higher
+        const int rows = info.height - kTitleRows;
+        rasters.color.Clear();
+        RECT area = { 0, -kTitleRows, profile.dots, rows };
+        GdiRenderer gdi(rasters.color.Dc());
+        drawSection(gdi, section, area, profile.draw[section]);
+        GdiFlush();
+        convertToMono(rasters.color, rows, dither, profile.threshold, rasters.mono);
+        encodeRows(profile, rasters.mono, rows, out, stats);
+        escposFeedLines(out, profile.feedBetweenSections);
+    }
+    escposFeedLines(doc.Bytes(), profile.feedEnd);
+    doc.Finish();
+    return true;
+}
+
+// The same report as one contiguous stream in out, which is cleared first
+// but keeps its capacity
+bool BuildEscPosReport(const PrinterProfile& profile, DitherMode dither, bool hybridText, PrintRasters& rasters,
+    std::vector<uint8_t>& out, RasterStats& stats, const std::atomic<bool>* cancel = nullptr) {
+    out.clear();
+    if (!BuildEscPosDocument(profile, dither, hybridText, rasters, rasters.document, stats, cancel)) return false;
+    rasters.document.Flatten(out);
+    return true;
+}
+
+// ---- Printer transports ----
+// Posted to the main window while a job is sent: wParam = bytes acknowledged,
+// lParam = total bytes
+enum { WM_APP_PRINT_PROGRESS = WM_APP + 2 };
+
+// Destination of an encoded ESC/POS stream. SendGather() writes the buffers
+// in order as one stream, blocking the calling worker thread until
+// everything is written or 'cancel' is raised, and reports progress to
+// 'notify'.
+class PrinterTransport {
+public:
+    virtual ~PrinterTransport() {}
+    virtual bool Connect() = 0;
+    virtual bool SendGather(const GatherBuffer* buffers, size_t count, HWND notify, const std::atomic<bool>* cancel = nullptr) = 0;
+    bool Send(const uint8_t* data, size_t size, HWND notify, const std::atomic<bool>* cancel = nullptr) {
+        const GatherBuffer buffer = { data, size };
+        return SendGather(&buffer, 1, notify, cancel);
+    }
+    virtual const wchar_t* Describe() const = 0;
+    const std::wstring& LastError() const { return error; }
+protected:
+    std::wstring error;
+};
+
+// Writes the stream to a file; used when no printer is configured
+class FileTransport : public PrinterTransport {
+public:
+    explicit FileTransport(const std::wstring& path) : path(path) {}
+    bool Connect() override { return true; }
+    bool SendGather(const GatherBuffer* buffers, size_t count, HWND notify, const std::atomic<bool>* cancel = nullptr) override {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = L"Could not create " + path;
+            return false;
+        }
+        bool ok = true;
+        size_t size = 0;
+        for (size_t i = 0; i < count && ok; ++i) {
+            DWORD n = 0;
+            ok = WriteFile(file, buffers[i].data, (DWORD)buffers[i].size, &n, NULL) && n == buffers[i].size;
+            size += n;
+        }
+        CloseHandle(file);
+        if (!ok) error = L"Could not write " + path;
+        else if (notify) PostMessage(notify, WM_APP_PRINT_PROGRESS, (WPARAM)size, (LPARAM)size);
+        return ok;
+    }
+    const wchar_t* Describe() const override { return path.c_str(); }
+private:
+    std::wstring path;
+};
+
+// Parse "AA:BB:CC:DD:EE:FF" (or plain hex) into a 48-bit Bluetooth address
+uint64_t parseBluetoothAddress(const wchar_t* text) {
+    uint64_t v = 0;
+    int digits = 0;
+    for (const wchar_t* p = text; *p; ++p) {
+        int d;
+        if (*p >= L'0' && *p <= L'9') d = *p - L'0';
+        else if (*p >= L'a' && *p <= L'f') d = *p - L'a' + 10;
+        else if (*p >= L'A' && *p <= L'F') d = *p - L'A' + 10;
+        else if (*p == L':' || *p == L'-') continue;
+        else return 0;
+        v = (v << 4) | (uint64_t)d;
+        ++digits;
+    }
+    return digits == 12 ? v : 0;
+}
+
+std::wstring formatBluetoothAddress(uint64_t address) {
+    wchar_t text[18];
+    swprintf(text, 18, L"%02X:%02X:%02X:%02X:%02X:%02X", (unsigned)(address >> 40) & 0xFF, (unsigned)(address >> 32) & 0xFF,
+        (unsigned)(address >> 24) & 0xFF, (unsigned)(address >> 16) & 0xFF, (unsigned)(address >> 8) & 0xFF, (unsigned)address & 0xFF);
+    return text;
+}
+
+// BLE GATT transport over the WinRT Bluetooth APIs. The ESC/POS stream is
+// split into chunks of the negotiated ATT payload (MaxPduSize - 3) and up to
+// maxInFlight write-without-response operations are kept outstanding; a
+// semaphore holds the credits and every completion returns one. Windows
+// negotiates the MTU itself when the session is opened, so the transport
+// follows MaxPduSize (and its change event) instead of requesting a size.
+// Needs C++/WinRT (MSVC with the Windows SDK); other builds get a transport
+// whose Connect() fails with an explanation, and printing falls back to file.
+class BleGattTransport : public PrinterTransport {
+public:
+    BleGattTransport(uint64_t address, int maxInFlight = 4) : address(address), maxInFlight(std::max(1, maxInFlight)) {}
+    ~BleGattTransport() override { Disconnect(); }
+    bool Connect() override { return Connect(nullptr); }
+    // gives up as soon as 'cancel' is raised
+    bool Connect(const std::atomic<bool>* cancel);
+    bool SendGather(const GatherBuffer* buffers, size_t count, HWND notify, const std::atomic<bool>* cancel = nullptr) override;
+    const wchar_t* Describe() const override { return L"BLE GATT"; }
+    void Disconnect();
+    bool Connected() const;
+    int Mtu() const { return mtu.load(); }
+private:
+    uint64_t address;
+    int maxInFlight;
+    std::atomic<int> mtu{ 23 };
+#if defined(ER_HAVE_WINRT_BLE)
+    winrt::Windows::Devices::Bluetooth::BluetoothLEDevice device{ nullptr };
+    winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattSession session{ nullptr };
+    winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattCharacteristic characteristic{ nullptr };
+    winrt::event_token mtuToken{};
+    bool withoutResponse = true;
+#endif
+};
+
+#if defined(ER_HAVE_WINRT_BLE)
+// Printer services/characteristics tried first, as in the JS config
+static const winrt::guid kPrinterServices[] = {
+    { 0x000018F0, 0x0000, 0x1000, { 0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB } },
+    { 0xE7810A71, 0x73AE, 0x499D, { 0x8C, 0x15, 0xFA, 0xA9, 0xAE, 0xF0, 0xC3, 0xF2 } }
+};
+static const winrt::guid kPrinterCharacteristics[] = {
+    { 0x00002AF1, 0x0000, 0x1000, { 0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB } },
+    { 0xBEF8D6C9, 0x9C21, 0x4C9E, { 0xB6, 0x32, 0xBD, 0x58, 0xC1, 0x00, 0x9F, 0x9F } }
+};
+
+// get() that gives up, cancelling op, once 'cancel' is raised
+template <typename T>
+T awaitCancellable(winrt::Windows::Foundation::IAsyncOperation<T> const& op, const std::atomic<bool>* cancel) {
+    using winrt::Windows::Foundation::AsyncStatus;
+    while (op.Status() == AsyncStatus::Started) {
+        if (cancel && *cancel) {
+            op.Cancel();
+            throw winrt::hresult_canceled();
+        }
+        Sleep(20);
+    }
+    return op.GetResults();
+}
+
+bool BleGattTransport::Connect(const std::atomic<bool>* cancel) {
+    using namespace winrt::Windows::Devices::Bluetooth;
+    using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+    // the transport outlives jobs: never report an earlier job's error
+    error.clear();
+    if (characteristic) return true;
+    try {
+        winrt::init_apartment(winrt::apartment_type::multi_threaded);
+    } catch (const winrt::hresult_error&) {
+        // apartment already initialized on this thread
+    }
+    try {
+        device = awaitCancellable(BluetoothLEDevice::FromBluetoothAddressAsync(address), cancel);
+        if (!device) {
+            error = L"Printer not found";
+            return false;
+        }
+        session = awaitCancellable(GattSession::FromDeviceIdAsync(device.BluetoothDeviceId()), cancel);
+        session.MaintainConnection(true);
+        mtu = session.MaxPduSize();
+        mtuToken = session.MaxPduSizeChanged([this](GattSession const& s, winrt::Windows::Foundation::IInspectable const&) {
+            mtu = s.MaxPduSize();
+        });
+        GattDeviceServicesResult services = awaitCancellable(device.GetGattServicesAsync(BluetoothCacheMode::Uncached), cancel);
+        if (services.Status() != GattCommunicationStatus::Success) {
+            error = L"GATT service discovery failed";
+            return false;
+        }
+        // preferred services and characteristics first, then anything writable
+        GattCharacteristic fallback{ nullptr };
+        for (GattDeviceService const& service : services.Services()) {
+            bool preferredService = std::find(std::begin(kPrinterServices), std::end(kPrinterServices), service.Uuid()) != std::end(kPrinterServices);
+            GattCharacteristicsResult chars = awaitCancellable(service.GetCharacteristicsAsync(BluetoothCacheMode::Uncached), cancel);
+            if (chars.Status() != GattCommunicationStatus::Success) continue;
+            for (GattCharacteristic const& c : chars.Characteristics()) {
+                GattCharacteristicProperties props = c.CharacteristicProperties();
+                bool nr = (props & GattCharacteristicProperties::WriteWithoutResponse) == GattCharacteristicProperties::WriteWithoutResponse;
+                bool wr = (props & GattCharacteristicProperties::Write) == GattCharacteristicProperties::Write;
+                if (!nr && !wr) continue;
+                bool preferred = preferredService || std::find(std::begin(kPrinterCharacteristics), std::end(kPrinterCharacteristics), c.Uuid()) != std::end(kPrinterCharacteristics);
+                if (preferred && !characteristic) {
+                    characteristic = c;
+                    withoutResponse = nr;
+                }
+                if (!fallback) fallback = c;
+            }
+        }
+        if (!characteristic && fallback) {
+            characteristic = fallback;
+            withoutResponse = (fallback.CharacteristicProperties() & GattCharacteristicProperties::WriteWithoutResponse) == GattCharacteristicProperties::WriteWithoutResponse;
+        }
+        if (!characteristic) {
+            error = L"No writable printer characteristic";
+            return false;
+        }
+        return true;
+    } catch (const winrt::hresult_error& e) {
+        error = cancel && *cancel ? std::wstring(L"Cancelled") : std::wstring(L"BLE error: ") + e.message().c_str();
+        Disconnect();
+        return false;
+    }
+}
+
+bool BleGattTransport::SendGather(const GatherBuffer* buffers, size_t count, HWND notify, const std::atomic<bool>* cancel) {
+    using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+    using winrt::Windows::Foundation::AsyncStatus;
+    using winrt::Windows::Foundation::IAsyncOperation;
+    if (!Connect(cancel)) return false;
+    error.clear();
+    // State the completions touch. Each completion holds a reference, so a
+    // write that finishes after this function gave up on it still finds the
+    // counters and the semaphore alive; the last reference closes it.
+    struct Window {
+        HANDLE credits = NULL;
+        std::atomic<size_t> acked{ 0 };
+        std::atomic<bool> failed{ false };
+        std::atomic<int> lastPercent{ -1 };
+        size_t size = 0;
+        HWND notify = NULL;
+        ~Window() {
+            if (credits) CloseHandle(credits);
+        }
+    };
+    std::shared_ptr<Window> window = std::make_shared<Window>();
+    window->credits = CreateSemaphoreW(NULL, maxInFlight, maxInFlight, NULL);
+    if (!window->credits) {
+        error = L"Could not create the write window";
+        return false;
+    }
+    window->notify = notify;
+    std::atomic<bool>& failed = window->failed;
+    GattWriteOption option = withoutResponse ? GattWriteOption::WriteWithoutResponse : GattWriteOption::WriteWithResponse;
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i) size += buffers[i].size;
+    window->size = size;
+    std::vector<IAsyncOperation<GattWriteResult>> pending; // at most maxInFlight still running
+    // chunks fill up across buffer boundaries
+    size_t offset = 0, part = 0, partOffset = 0;
+    try {
+        while (offset < size && !failed) {
+            if (cancel && *cancel) {
+                failed = true;
+                error = L"Cancelled";
+                break;
+            }
+            // wait for a free slot in the credit window, watching for cancel
+            DWORD waited = 0;
+            while (WaitForSingleObject(window->credits, 50) != WAIT_OBJECT_0 && !(cancel && *cancel) && waited < 10000) waited += 50;
+            if (cancel && *cancel) {
+                failed = true;
+                error = L"Cancelled";
+                break;
+            }
+            if (waited >= 10000) {
+                failed = true;
+                error = L"Printer stopped acknowledging writes";
+                break;
+            }
+            size_t len = std::min(size - offset, (size_t)std::max(20, mtu.load() - 3));
+            winrt::Windows::Storage::Streams::Buffer buffer((uint32_t)len);
+            for (size_t copied = 0; copied < len;) {
+                while (partOffset == buffers[part].size) {
+                    ++part;
+                    partOffset = 0;
+                }
+                size_t n = std::min(len - copied, buffers[part].size - partOffset);
+                memcpy(buffer.data() + copied, buffers[part].data + partOffset, n);
+                copied += n;
+                partOffset += n;
+            }
+            buffer.Length((uint32_t)len);
+            IAsyncOperation<GattWriteResult> op = characteristic.WriteValueWithResultAsync(buffer, option);
+            op.Completed([window, len](IAsyncOperation<GattWriteResult> const& done, AsyncStatus status) {
+                if (status != AsyncStatus::Completed || done.GetResults().Status() != GattCommunicationStatus::Success) {
+                    window->failed = true;
+                } else {
+                    size_t total = window->acked += len;
+                    int percent = (int)(total * 100 / window->size);
+                    if (window->notify && window->lastPercent.exchange(percent) != percent) {
+                        PostMessage(window->notify, WM_APP_PRINT_PROGRESS, (WPARAM)total, (LPARAM)window->size);
+                    }
+                }
+                ReleaseSemaphore(window->credits, 1, NULL);
+            });
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                [](const IAsyncOperation<GattWriteResult>& o) { return o.Status() != AsyncStatus::Started; }), pending.end());
+            pending.push_back(op);
+            offset += len;
+        }
+    } catch (const winrt::hresult_error& e) {
+        failed = true;
+        error = std::wstring(L"BLE error: ") + e.message().c_str();
+    }
+    // a failed or cancelled send does not wait for the printer: cancelled
+    // writes complete at once and return their credits
+    if (failed) {
+        for (IAsyncOperation<GattWriteResult>& op : pending) {
+            try {
+                if (op.Status() == AsyncStatus::Started) op.Cancel();
+            } catch (const winrt::hresult_error&) {
+                // completed meanwhile
+            }
+        }
+    }
+    // drain the window: every outstanding write returns its credit, within
+    // 10 s in all. A write still stuck after that keeps window alive on its own.
+    const ULONGLONG drainUntil = GetTickCount64() + 10000;
+    for (int i = 0; i < maxInFlight; ++i) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= drainUntil || WaitForSingleObject(window->credits, (DWORD)(drainUntil - now)) != WAIT_OBJECT_0) {
+            failed = true;
+            break;
+        }
+    }
+    if (failed && error.empty()) error = L"GATT write failed";
+    return !failed && window->acked == size;
+}
+
+bool BleGattTransport::Connected() const { return characteristic != nullptr; }
+
+void BleGattTransport::Disconnect() {
+    if (session) {
+        session.MaxPduSizeChanged(mtuToken);
+        session.Close();
+    }
+    characteristic = nullptr;
+    session = nullptr;
+    if (device) device.Close();
+    device = nullptr;
+}
+#else
+bool BleGattTransport::Connect(const std::atomic<bool>*) {
+    error = L"This build has no BLE support (requires C++/WinRT)";
+    return false;
+}
+
+bool BleGattTransport::SendGather(const GatherBuffer*, size_t, HWND, const std::atomic<bool>*) {
+    return Connect();
+}
+
+bool BleGattTransport::Connected() const { return false; }
+
+void BleGattTransport::Disconnect() {}
+#endif
+
+// ---- Printer pool ----
+// Every configured BLE printer is a PrinterDevice whose transport keeps the
+// GATT session, the chosen characteristic and the negotiated MTU from one
+// job to the next, so discovery only happens on the first job and after a
+// failed one. PrinterManager fans a finished document out to all devices at
+// once: one thread per device, all sending the same gather list, whose
+// buffers are shared read-only and never copied.
+struct PrinterDeviceStats {
+    uint64_t address = 0;
+    int jobs = 0;
+    int failures = 0;
+    int mtu = 0;
+    uint64_t bytes = 0;          // sent successfully
+    double connectMs = 0.0;      // last connection setup, paid again after a failure
+    double lastSendMs = 0.0;
+    double totalSendMs = 0.0;    // of the successful sends
+    double KBPerSecond() const { return totalSendMs > 0.0 ? bytes / 1024.0 / (totalSendMs / 1000.0) : 0.0; }
+    double AverageSendMs() const { return jobs > failures ? totalSendMs / (jobs - failures) : 0.0; }
+};
+
+// Outcome of one job on one device
+struct PrinterResult {
+    uint64_t address = 0;
+    bool sent = false;
+    bool reconnected = false;    // the pooled connection had to be (re)opened
+    double sendMs = 0.0;
+    std::wstring error;
+};
+
+class PrinterDevice {
+public:
+    explicit PrinterDevice(uint64_t address) : transport(address) {
+        InitializeSRWLock(&lock);
+        stats.address = address;
+    }
+    uint64_t Address() const { return stats.address; }
+
+    // One send at a time per device; the spooler worker runs one job at a time
+    void Send(const std::vector<GatherBuffer>& buffers, size_t size, HWND notify, const std::atomic<bool>* cancel, PrinterResult& result) {
+        result.address = stats.address;
+        LARGE_INTEGER start;
+        QueryPerformanceCounter(&start);
+        result.reconnected = !transport.Connected();
+        bool connected = transport.Connect(cancel);
+        double connectMs = secondsSince(start) * 1000.0;
+        QueryPerformanceCounter(&start);
+        result.sent = connected && transport.SendGather(buffers.data(), buffers.size(), notify, cancel);
+        result.sendMs = secondsSince(start) * 1000.0;
+        if (!result.sent) {
+            result.error = transport.LastError();
+            // a broken session is rediscovered by the next job
+            if (!(cancel && *cancel)) transport.Disconnect();
+        }
+        AcquireSRWLockExclusive(&lock);
+        stats.jobs++;
+        stats.mtu = transport.Mtu();
+        if (result.reconnected) stats.connectMs = connectMs;
+        stats.lastSendMs = result.sendMs;
+        if (result.sent) {
+            stats.bytes += size;
+            stats.totalSendMs += result.sendMs;
+        } else {
+            stats.failures++;
+        }
+        ReleaseSRWLockExclusive(&lock);
+    }
+
+    PrinterDeviceStats Stats() const {
+        AcquireSRWLockShared(&lock);
+        PrinterDeviceStats copy = stats;
+        ReleaseSRWLockShared(&lock);
+        return copy;
+    }
+
+    void Close() { transport.Disconnect(); }
+private:
+    BleGattTransport transport;
+    mutable SRWLOCK lock; // guards stats, which the UI thread reads
+    PrinterDeviceStats stats;
+};
+
+class PrinterManager {
+public:
+    // Called once at startup, before the spooler runs; duplicates are dropped
+    void Configure(const std::vector<uint64_t>& addresses) {
+        for (uint64_t address : addresses) {
+            if (!Find(address)) devices.emplace_back(new PrinterDevice(address));
+        }
+    }
+    size_t Count() const { return devices.size(); }
+
+    // Send doc to every device concurrently and wait for all of them.
+    // Transfer progress on the print button follows the first device.
+    // Returns true when every device printed it.
+    bool FanOut(const EscPosDocument& doc, HWND notify, const std::atomic<bool>* cancel, std::vector<PrinterResult>& results) {
+        std::vector<GatherBuffer> buffers;
+        doc.Buffers(buffers);
+        results.assign(devices.size(), PrinterResult());
+        std::vector<SendTask> tasks(devices.size());
+        std::vector<HANDLE> threads;
+        for (size_t i = 0; i < devices.size(); ++i) {
+            tasks[i] = { devices[i].get(), &buffers, doc.Size(), i == 0 ? notify : NULL, cancel, &results[i] };
+            // the first device is served by the calling thread
+            HANDLE thread = i > 0 ? CreateThread(NULL, 0, SendMain, &tasks[i], 0, NULL) : NULL;
+            if (thread) threads.push_back(thread);
+            else if (i > 0) SendMain(&tasks[i]);
+        }
+        if (!tasks.empty()) SendMain(&tasks[0]);
+        for (HANDLE thread : threads) {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+        bool all = !results.empty();
+        for (const PrinterResult& r : results) all = all && r.sent;
+        return all;
+    }
+
+    void Stats(std::vector<PrinterDeviceStats>& out) const {
+        out.clear();
+        for (const std::unique_ptr<PrinterDevice>& d : devices) out.push_back(d->Stats());
+    }
+
+    // Drop the pooled connections; the spooler must be stopped
+    void Close() {
+        for (const std::unique_ptr<PrinterDevice>& d : devices) d->Close();
+    }
+private:
+    struct SendTask {
+        PrinterDevice* device;
+        const std::vector<GatherBuffer>* buffers;
+        size_t size;
+        HWND notify;
+        const std::atomic<bool>* cancel;
+        PrinterResult* result;
+    };
+    static DWORD WINAPI SendMain(LPVOID param) {
+        SendTask* t = (SendTask*)param;
+        t->device->Send(*t->buffers, t->size, t->notify, t->cancel, *t->result);
+        return 0;
+    }
+    PrinterDevice* Find(uint64_t address) const {
+        for (const std::unique_ptr<PrinterDevice>& d : devices) {
+            if (d->Address() == address) return d.get();
+        }
+        return nullptr;
+    }
+    std::vector<std::unique_ptr<PrinterDevice>> devices; // fixed after Configure
+};
+static PrinterManager g_printers;
+
+// Posted to the main window with a PrintJob* in lParam once the job is built
+enum { WM_APP_PRINT_READY = WM_APP + 1 };
+
+// Bounded multi-producer/multi-consumer queue (Vyukov): every cell carries a
+// sequence number telling producers and consumers whose turn it is, so push
+// and pop are a single CAS on the tail/head index with no lock. N must be a
+// power of two.
+template <typename T, size_t N>
+class BoundedQueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+public:
+    BoundedQueue() {
+        for (size_t i = 0; i < N; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    // false when the queue is full
+    bool TryPush(const T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & (N - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    // false when the queue is empty
+    bool TryPop(T& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & (N - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + N, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    Cell cells[N];
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
+
+// One print request. The UI thread creates it with a private snapshot of the
+// day, the spooler worker fills in the result and posts it back with
+// WM_APP_PRINT_READY, and the UI thread deletes it.
+struct PrintJob {
+    HWND notify;
+    const PrinterProfile* profile;
+    DitherMode dither;
+    bool toPrinters;              // every device of g_printers; false: write to EnergyReport.escpos
+    bool hybridText;              // text sections in printer fonts, charts as raster
+    uint64_t rasterKey;           // identifies the encoded content, see PrintSpooler::RasterKey
+    uint64_t key;                 // rasterKey + destination; equal keys are coalesced
+    EnergyDay day;
+    std::atomic<bool> cancel{ false };
+    // results
+    std::shared_ptr<const EscPosDocument> bytes;
+    RasterStats rasterStats;
+    bool fromCache = false;
+    bool cancelled = false;
+    double buildMs = 0.0;
+    double sendMs = 0.0;
+    bool sent = false;
+    std::wstring destination;
+    std::wstring error;
+    std::vector<PrinterResult> printers; // one per device when toPrinters
+};
+
+// Print spooler: one worker thread fed through a bounded lock-free queue.
+// Submit/Cancel/Complete are called on the UI thread only; it keeps the list
+// of outstanding jobs, which is what lets mashing the print button coalesce
+// into a single print. The worker keeps the last few encoded reports, so a
+// reprint of unchanged data skips rendering entirely.
+class PrintSpooler {
+public:
+    static const size_t kRasterCacheSize = 4;
+
+    bool Start() {
+        if (thread) return true;
+        wake = CreateSemaphoreW(NULL, 0, 1 << 16, NULL);
+        stopping = false;
+        thread = wake ? CreateThread(NULL, 0, ThreadMain, this, 0, NULL) : NULL;
+        return thread != NULL;
+    }
+
+    // Cancel everything and wait for the worker to exit; builds and sends
+    // observe the cancel flag, so this takes no longer than the current
+    // section or write. UI thread only: jobs the worker already posted back
+    // are taken out of the message queue and deleted. Returns false when the
+    // worker could not be waited for, and whatever it uses must stay alive.
+    bool Stop() {
+        if (!thread) return true;
+        CancelAll();
+        stopping = true;
+        ReleaseSemaphore(wake, 1, NULL);
+        bool exited = WaitForSingleObject(thread, INFINITE) == WAIT_OBJECT_0;
+        CloseHandle(thread);
+        CloseHandle(wake);
+        thread = wake = NULL;
+        PrintJob* job;
+        while (queue.TryPop(job)) delete job;
+        MSG msg;
+        while (PeekMessage(&msg, NULL, WM_APP_PRINT_READY, WM_APP_PRINT_READY, PM_REMOVE)) delete (PrintJob*)msg.lParam;
+        outstanding.clear();
+        return exited;
+    }
+
+    // Key of the rendered bytes: same data, printer profile, dither and print mode
+    static uint64_t RasterKey(uint64_t dataVersion, const PrinterProfile* profile, DitherMode dither, bool hybridText) {
+        uint64_t h = dataVersion * 0x9E3779B97F4A7C15ULL;
+        h ^= (uint64_t)(uintptr_t)profile + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+        h ^= (uint64_t)dither + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+        h ^= (uint64_t)hybridText + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    // Queue a job. Returns false (and deletes the job) when an identical job
+    // is already queued or printing, or when the queue is full.
+    bool Submit(PrintJob* job) {
+        job->key = job->rasterKey ^ (job->toPrinters ? 0xFF51AFD7ED558CCDULL : 0);
+        for (PrintJob* other : outstanding) {
+            if (other->key == job->key && !other->cancel) {
+                delete job;
+                return false;
+            }
+        }
+        if (!thread || !queue.TryPush(job)) {
+            delete job;
+            return false;
+        }
+        outstanding.push_back(job);
+        ReleaseSemaphore(wake, 1, NULL);
+        return true;
+    }
+
+    void CancelAll() {
+        for (PrintJob* job : outstanding) job->cancel = true;
+    }
+
+    // A job came back through WM_APP_PRINT_READY
+    void Complete(PrintJob* job) {
+        outstanding.erase(std::remove(outstanding.begin(), outstanding.end(), job), outstanding.end());
     }
+
+    bool Busy() const { return !outstanding.empty(); }
+
 private:
-    uint64_t state;
-};
+    struct CachedRaster {
+        uint64_t key;
+        std::shared_ptr<const EscPosDocument> bytes;
+        RasterStats stats;
+        uint64_t lastUse;
+    };
 
-// ---- Data structures for energy report ----
-struct Consumer {
-    std::string name;
-    double kWh;
-};
-struct Category {
-    std::string name;
-    double kWh;
-};
-struct EnergyDay {
-    std::string buildingName;
-    SYSTEMTIME date;
-    std::vector<double> hourlyKWh;
-    std::vector<Consumer> topConsumers;
-    std::vector<Category> categoryBreakdown;
-    double priceCZKPerKWh;
-};
+    static DWORD WINAPI ThreadMain(LPVOID self) {
+        ((PrintSpooler*)self)->Run();
+        return 0;
+    }
 
-// Simulate a day of energy usage with reproducible random variations
-EnergyDay simulateEnergyDay() {
-    SeededRNG rng(0xC0FFEEULL);
-    EnergyDay day;
-    day.buildingName = "Kancelářská budova A (menší)";
-    // current date
-    GetLocalTime(&day.date);
-    day.priceCZKPerKWh = 3.20;
-    day.hourlyKWh.resize(24);
-    for (int h = 0; h < 24; ++h) {
-        double baseNight = 6.5;
-        double baseWork = 16.0;
-        double baseEvening = 10.0;
-        double base;
-        if (h < 6 || h >= 23) base = baseNight;
-        else if (h < 8) base = baseNight + 3.0;
-        else if (h <= 18) base = baseWork;
-        else base = baseEvening;
-        double wave = (h >= 8 && h <= 18) ? (7.0 * std::sin((h - 8.0) / 10.0 * 3.14159265358979323846)) : 0.0;
-        double noise = (rng.nextDouble01() - 0.5) * 2.0;
-        double spike = (rng.nextDouble01() < 0.08) ? (5.0 + rng.nextDouble01() * 10.0) : 0.0;
-        double kWh = std::max(3.0, base + wave + noise + spike);
-        day.hourlyKWh[h] = kWh;
+    void Run() {
+        // render targets and GDI objects live as long as the worker; print
+        // sections are laid out at 96 DPI whatever the monitors are
+        GdiCache gdi;
+        PrintRasters rasters;
+        ReportLayout layout;
+        while (WaitForSingleObject(wake, INFINITE) == WAIT_OBJECT_0 && !stopping) {
+            PrintJob* job;
+            if (!queue.TryPop(job)) continue;
+            Process(job, gdi, rasters, layout);
+            if (!PostMessage(job->notify, WM_APP_PRINT_READY, 0, (LPARAM)job)) delete job;
+        }
     }
-    // total consumption
-    double total = 0.0;
-    for (double v : day.hourlyKWh) total += v;
-    // categories (shares)
-    const struct { const char* name; double share; } cats[] = {
-        {"HVAC (chlazení + VZT)", 0.42},
-        {"Osvětlení", 0.22},
-        {"IT + serverovna", 0.18},
-        {"Zásuvky / kuchyňky", 0.10},
-        {"Ostatní", 0.08}
-    };
-    day.categoryBreakdown.clear();
-    for (auto& c : cats) {
-        Category cat;
-        cat.name = c.name;
-        cat.kWh = total * c.share;
-        day.categoryBreakdown.push_back(cat);
+
+    void Process(PrintJob* job, GdiCache& gdi, PrintRasters& rasters, const ReportLayout& layout) {
+        LARGE_INTEGER start;
+        QueryPerformanceCounter(&start);
+        job->fromCache = FindRaster(job->rasterKey, job->bytes, job->rasterStats);
+        if (!job->bytes && !job->cancel) {
+            std::shared_ptr<EscPosDocument> bytes = std::make_shared<EscPosDocument>();
+            ScopedRenderBinding bind(&job->day, &gdi, &layout);
+            if (BuildEscPosDocument(*job->profile, job->dither, job->hybridText, rasters, *bytes, job->rasterStats, &job->cancel)) {
+                job->bytes = bytes;
+                StoreRaster(job->rasterKey, job->bytes, job->rasterStats);
+            }
+        }
+        job->buildMs = secondsSince(start) * 1000.0;
+        ER_TRACE_SINCE(TracePrintBuild, start.QuadPart, job->bytes ? job->bytes->Size() : 0);
+        if (job->cancel || !job->bytes) {
+            job->cancelled = job->cancel;
+            job->error = job->cancel ? L"Cancelled" : L"Rendering failed";
+            return;
+        }
+        // send from the worker so the UI thread never waits on the printer
+        QueryPerformanceCounter(&start);
+        if (job->toPrinters) {
+            job->destination = g_printers.Count() == 1 ? L"BLE GATT" : std::to_wstring(g_printers.Count()) + L" BLE printers";
+            job->sent = g_printers.FanOut(*job->bytes, job->notify, &job->cancel, job->printers);
+            for (const PrinterResult& r : job->printers) {
+                if (!r.sent && job->error.empty()) job->error = formatBluetoothAddress(r.address) + L": " + r.error;
+            }
+        } else {
+            FileTransport transport(L"EnergyReport.escpos");
+            job->destination = transport.Describe();
+            std::vector<GatherBuffer> buffers;
+            job->bytes->Buffers(buffers);
+            job->sent = transport.SendGather(buffers.data(), buffers.size(), job->notify, &job->cancel);
+            job->error = transport.LastError();
+        }
+        job->cancelled = !job->sent && job->cancel;
+        job->sendMs = secondsSince(start) * 1000.0;
+        ER_TRACE_SINCE(TracePrintSend, start.QuadPart, job->sent ? job->bytes->Size() : 0);
     }
-    // top consumers
-    const struct { const char* name; double share; } consumersRaw[] = {
-        {"Chiller / tepelné čerpadlo", 0.22},
-        {"VZT jednotky", 0.17},
-        {"Osvětlení open-space", 0.15},
-        {"Serverovna UPS", 0.14},
-        {"EV nabíjení", 0.10},
-        {"Výtahy", 0.05},
-        {"Ostatní", 0.17}
-    };
-    std::vector<Consumer> list;
-    for (auto& cr : consumersRaw) {
-        Consumer cons;
-        cons.name = cr.name;
-        cons.kWh = total * cr.share;
-        list.push_back(cons);
+
+    bool FindRaster(uint64_t key, std::shared_ptr<const EscPosDocument>& bytes, RasterStats& stats) {
+        for (CachedRaster& c : rasterCache) {
+            if (c.key == key) {
+                c.lastUse = ++useClock;
+                bytes = c.bytes;
+                stats = c.stats;
+                return true;
+            }
+        }
+        return false;
     }
-    // sort by descending consumption and take top 6
-    std::sort(list.begin(), list.end(), [](const Consumer& a, const Consumer& b) { return a.kWh > b.kWh; });
-    day.topConsumers.assign(list.begin(), list.begin() + 6);
-    return day;
+
+    void StoreRaster(uint64_t key, std::shared_ptr<const EscPosDocument> bytes, const RasterStats& stats) {
+        if (rasterCache.size() >= kRasterCacheSize) {
+            auto oldest = std::min_element(rasterCache.begin(), rasterCache.end(),
+                [](const CachedRaster& a, const CachedRaster& b) { return a.lastUse < b.lastUse; });
+            rasterCache.erase(oldest);
+        }
+        rasterCache.push_back({ key, std::move(bytes), stats, ++useClock });
+    }
+
+    BoundedQueue<PrintJob*, 8> queue;
+    HANDLE wake = NULL;       // semaphore, one count per queued job
+    HANDLE thread = NULL;
+    std::atomic<bool> stopping{ false };
+    std::vector<PrintJob*> outstanding;   // UI thread only
+    std::vector<CachedRaster> rasterCache; // worker thread only
+    uint64_t useClock = 0;
+};
+static PrintSpooler g_spooler;
+
+#if ENERGY_REPORT_TRACE
+// ---- Timing overlay and trace export ----
+// F9 toggles a box in the top-right corner of the report that shows the
+// latest and average time of painting and of every section, the process's
+// GDI object count and the last print job's build time and send rate. It is
+// drawn straight onto the window after the sections and refreshed twice a
+// second while visible.
+enum { OverlayTimerId = 24 };
+static bool g_overlay = false;
+
+RECT OverlayRect(HWND hwnd) {
+    const ReportLayout& m = g_layout;
+    RECT client;
+    GetClientRect(hwnd, &client);
+    int top = BandHeight() + m.Px(6);
+    int rows = TraceCount + 2 + (int)g_printers.Count();
+    RECT r = { client.right - m.Px(270), top, client.right - m.Px(10), top + m.Px(16) * rows + m.Px(14) };
+    return r;
 }
 
-// Helper to format date as dd.mm.yyyy
-std::wstring formatDate(const SYSTEMTIME& st) {
-    std::wostringstream oss;
-    oss << std::setfill(L'0') << std::setw(2) << st.wDay << L"." << std::setw(2) << st.wMonth << L"." << st.wYear;
-    return oss.str();
+void InvalidateOverlay(HWND hwnd) {
+    if (!g_overlay) return;
+    RECT r = OverlayRect(hwnd);
+    InvalidateRect(hwnd, &r, FALSE);
 }
 
-// Global pointer to hold the simulated data
-static EnergyDay g_day;
+void ToggleOverlay(HWND hwnd) {
+    RECT r = OverlayRect(hwnd);
+    g_overlay = !g_overlay;
+    if (g_overlay) SetTimer(hwnd, OverlayTimerId, 500, NULL);
+    else KillTimer(hwnd, OverlayTimerId);
+    // hiding it repaints the sections from the cache
+    InvalidateRect(hwnd, &r, FALSE);
+}
+
+void DrawOverlay(HWND hwnd, HDC hdc, const RECT& paint) {
+    RECT box = OverlayRect(hwnd), hit;
+    if (!g_overlay || !IntersectRect(&hit, &box, &paint)) return;
+    struct Totals { int64_t last = 0, sum = 0; uint64_t value = 0; int count = 0; } totals[TraceCount];
+    static std::vector<TraceRing::Sample> samples; // UI thread only
+    g_traceRing.Read(samples);
+    for (const TraceRing::Sample& s : samples) {
+        Totals& t = totals[s.id];
+        t.last = s.ticks;
+        t.value = s.value;
+        t.sum += s.ticks;
+        t.count++;
+    }
+    const ReportLayout& m = g_layout;
+    GdiRenderer r(hdc);
+    r.Frame(box, m.Px(1));
+    int x = box.left + m.Px(8), y = box.top + m.Px(6);
+    r.Text(x, y, L"Časování [ms] (F9)", 9, true);
+    r.Text(box.right - m.Px(70), y, L"posl.", 9, true, TA_RIGHT);
+    r.Text(box.right - m.Px(8), y, L"průměr", 9, true, TA_RIGHT);
+    for (int id = TracePaint; id < TracePrintSubmit; ++id) {
+        const Totals& t = totals[id];
+        y += m.Px(16);
+        r.Text(x, y, kTraceNames[id], 9);
+        if (!t.count) continue;
+        r.Text(box.right - m.Px(70), y, Label().Fixed(traceTicksToMs(t.last), 2), 9, false, TA_RIGHT);
+        r.Text(box.right - m.Px(8), y, Label().Fixed(traceTicksToMs(t.sum) / t.count, 2), 9, false, TA_RIGHT);
+    }
+    y += m.Px(16);
+    r.Text(x, y, Label(L"GDI objekty: ").Int(GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS)), 9);
+    const Totals& build = totals[TracePrintBuild];
+    const Totals& send = totals[TracePrintSend];
+    y += m.Px(16);
+    Label print(L"Tisk: ");
+    if (!build.count) print.Add(L"zatím žádný");
+    else print.Add(L"sestavení ").Fixed(traceTicksToMs(build.last), 1).Add(L" ms");
+    r.Text(x, y, print, 9);
+    y += m.Px(16);
+    if (send.count && send.last > 0) {
+        double kbPerSecond = send.value / 1024.0 / (traceTicksToMs(send.last) / 1000.0);
+        r.Text(x, y, Label(L"Odeslání: ").Fixed(kbPerSecond, 1).Add(L" KB/s, ").Int((long long)(send.value / 1024)).Add(L" KB"), 9);
+    }
+    // pooled printers: throughput and mean send latency of each
+    static std::vector<PrinterDeviceStats> printers; // UI thread only
+    g_printers.Stats(printers);
+    for (const PrinterDeviceStats& d : printers) {
+        y += m.Px(16);
+        r.Text(x, y, Label(formatBluetoothAddress(d.address).c_str()).Add(L": ").Fixed(d.KBPerSecond(), 1).Add(L" KB/s, ")
+            .Int((long long)d.AverageSendMs()).Add(L" ms, ").Int(d.jobs).Add(L"×"), 9);
+    }
+}
 
-// Forward declarations of drawing functions
-void DrawHeader(HDC hdc, RECT& area);
-void DrawLineChart(HDC hdc, RECT& area);
-void DrawBarChart(HDC hdc, RECT& area);
-void DrawPieChart(HDC hdc, RECT& area);
-void DrawTable(HDC hdc, RECT& area);
-void DrawChecklist(HDC hdc, RECT& area);
+// Write the samples still in the ring as Chrome trace events ("ph":"X"),
+// loadable in chrome://tracing or Perfetto
+bool WriteChromeTrace(const std::wstring& path) {
+    std::vector<TraceRing::Sample> samples;
+    g_traceRing.Read(samples);
+    std::string json = "{\"traceEvents\":[\n";
+    int64_t origin = samples.empty() ? 0 : samples.front().start;
+    char line[192];
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const TraceRing::Sample& s = samples[i];
+        snprintf(line, sizeof(line),
+            "{\"name\":\"%ls\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"value\":%llu}}%s\n",
+            kTraceNames[s.id], s.thread, traceTicksToMs(s.start - origin) * 1000.0, traceTicksToMs(s.ticks) * 1000.0,
+            (unsigned long long)s.value, i + 1 < samples.size() ? "," : "");
+        json += line;
+    }
+    json += "]}\n";
+    FileTransport file(path);
+    return file.Send((const uint8_t*)json.data(), json.size(), NULL);
+}
+#endif
 
-// Forward declaration for printing stub
-void PrintReport();
+// Place the buttons and give them a font for the window's DPI
+void LayoutButtons(HWND hwnd) {
+    const ReportLayout& m = g_layout;
+    HFONT font = g_gdi.Font(9, FW_NORMAL, m.dpi);
+    SetWindowPos(GetDlgItem(hwnd, 1), NULL, m.Px(10), m.Px(10), m.Px(100), m.Px(30), SWP_NOZORDER | SWP_NOACTIVATE);
+    SetWindowPos(GetDlgItem(hwnd, 2), NULL, m.Px(120), m.Px(10), m.Px(80), m.Px(30), SWP_NOZORDER | SWP_NOACTIVATE);
+    SendMessage(GetDlgItem(hwnd, 1), WM_SETFONT, (WPARAM)font, TRUE);
+    SendMessage(GetDlgItem(hwnd, 2), WM_SETFONT, (WPARAM)font, TRUE);
+}
 
 // Window procedure
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_CREATE:
         // initialize the data once
-        g_day = simulateEnergyDay();
-        // create a print button
+        g_day = LoadInitialDay();
+        LoadFollowingDays(g_day);
+        ++g_dayVersion;
+        ++g_dayRevision;
+        if (!g_options.saveSnapshotPath.empty()) {
+            std::vector<const EnergyDay*> days;
+            for (int i = 0; i < ReportDayCount(); ++i) days.push_back(&ReportDay(i));
+            if (!ReportSnapshot::Write(g_options.saveSnapshotPath, days))
+                MessageBox(hwnd, (L"Could not write " + g_options.saveSnapshotPath).c_str(), L"Snapshot", MB_OK | MB_ICONWARNING);
+        }
+        if (g_importStats.bytes > 0) {
+            // show import throughput so nightly loads can be checked at a glance
+            wchar_t title[128];
+            swprintf(title, 128, L"Energetický report – import %.1f MB/s", g_importStats.MBps());
+            SetWindowTextW(hwnd, title);
+        }
+        // create a print button and a cancel button for queued/running prints
         CreateWindowEx(0, WC_BUTTON, L"Print Report", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
             10, 10, 100, 30, hwnd, (HMENU)1, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
+        CreateWindowEx(0, WC_BUTTON, L"Cancel", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+            120, 10, 80, 30, hwnd, (HMENU)2, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
+        EnableWindow(GetDlgItem(hwnd, 2), FALSE);
+#if defined(ER_HAVE_D2D)
+        g_useD2D = g_options.renderer != L"gdi" && g_d2d.Init();
+#endif
+        UpdateLayout(hwnd);
+        LayoutButtons(hwnd);
+        UpdateScrollBar(hwnd);
+        if (!g_options.liveSource.empty()) g_live.Start(hwnd, g_options.liveSource, g_options.liveRate);
         return 0;
     case WM_COMMAND:
         if (LOWORD(wParam) == 1) {
-            PrintReport();
+            PrintReport(hwnd);
+        } else if (LOWORD(wParam) == 2) {
+            g_spooler.CancelAll();
         }
         return 0;
+    case WM_APP_PRINT_READY:
+        FinishPrintJob((PrintJob*)lParam);
+        return 0;
+    case WM_APP_PRINT_PROGRESS:
+    {
+        // show transfer progress on the print button
+        wchar_t text[32];
+        swprintf(text, 32, L"Printing %d%%", lParam > 0 ? (int)((uint64_t)wParam * 100 / (uint64_t)lParam) : 0);
+        SetWindowTextW(GetDlgItem(hwnd, 1), text);
+        return 0;
+    }
     case WM_PAINT:
     {
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hwnd, &ps);
-        RECT client;
-        GetClientRect(hwnd, &client);
-        // define areas for each section (header + 5 charts) separated vertically with margins
-        const int margin = 10;
-        // header height fixed
-        RECT headerArea = { client.left + margin, client.top + margin + 40, client.right - margin, client.top + margin + 40 + 190 };
-        RECT lineArea   = { client.left + margin, headerArea.bottom + margin, client.right - margin, headerArea.bottom + margin + 260 };
-        RECT barArea    = { client.left + margin, lineArea.bottom + margin, client.right - margin, lineArea.bottom + margin + 250 };
-        RECT pieArea    = { client.left + margin, barArea.bottom + margin, client.right - margin, barArea.bottom + margin + 300 };
-        RECT tableArea  = { client.left + margin, pieArea.bottom + margin, client.right - margin, pieArea.bottom + margin + 320 };
-        RECT checkArea  = { client.left + margin, tableArea.bottom + margin, client.right - margin, tableArea.bottom + margin + 240 };
-        // draw background
-        FillRect(hdc, &ps.rcPaint, (HBRUSH)(COLOR_WINDOW + 1));
-        // call draw functions
-        DrawHeader(hdc, headerArea);
-        DrawLineChart(hdc, lineArea);
-        DrawBarChart(hdc, barArea);
-        DrawPieChart(hdc, pieArea);
-        DrawTable(hdc, tableArea);
-        DrawChecklist(hdc, checkArea);
+        {
+            ER_TRACE_SCOPE(TracePaint);
+            PaintReport(hdc, ps.rcPaint);
+        }
+#if ENERGY_REPORT_TRACE
+        DrawOverlay(hwnd, hdc, ps.rcPaint);
+#endif
         EndPaint(hwnd, &ps);
         return 0;
     }
+    case WM_ERASEBKGND:
+        // PaintReport covers the whole paint rectangle; erasing would only flicker
+        return 1;
     case WM_SIZE:
-        // request repaint on resize
-        InvalidateRect(hwnd, NULL, TRUE);
+        // repaint without erase; sections are only re-rendered if the width changed
+        if (UpdateLayout(hwnd)) g_sectionCache.Clear();
+        UpdateScrollBar(hwnd);
+        InvalidateRect(hwnd, NULL, FALSE);
+        return 0;
+    case WM_VSCROLL:
+    {
+        SCROLLINFO si = {};
+        si.cbSize = sizeof(si);
+        si.fMask = SIF_ALL;
+        GetScrollInfo(hwnd, SB_VERT, &si);
+        int y = g_scrollY;
+        switch (LOWORD(wParam)) {
+        case SB_LINEUP: y -= g_layout.Px(40); break;
+        case SB_LINEDOWN: y += g_layout.Px(40); break;
+        case SB_PAGEUP: y -= (int)si.nPage; break;
+        case SB_PAGEDOWN: y += (int)si.nPage; break;
+        case SB_THUMBTRACK:
+        case SB_THUMBPOSITION: y = si.nTrackPos; break;
+        case SB_TOP: y = 0; break;
+        case SB_BOTTOM: y = MaxScroll(hwnd); break;
+        }
+        ScrollReportTo(hwnd, y);
+        return 0;
+    }
+    case WM_MOUSEWHEEL:
+    {
+        // three lines of 40 (96-DPI) pixels per notch, high-resolution wheels scroll proportionally
+        int delta = GET_WHEEL_DELTA_WPARAM(wParam);
+        ScrollReportTo(hwnd, g_scrollY - MulDiv(delta, g_layout.Px(120), WHEEL_DELTA));
+        return 0;
+    }
+    case WM_DPICHANGED:
+    {
+        // moved to a monitor with another scale: take the suggested window
+        // rectangle (that sends WM_SIZE) and rescale buttons and layout
+        const RECT* suggested = (const RECT*)lParam;
+        SetWindowPos(hwnd, NULL, suggested->left, suggested->top, suggested->right - suggested->left,
+            suggested->bottom - suggested->top, SWP_NOZORDER | SWP_NOACTIVATE);
+        if (UpdateLayout(hwnd)) g_sectionCache.Clear();
+        LayoutButtons(hwnd);
+        UpdateScrollBar(hwnd);
+        InvalidateRect(hwnd, NULL, FALSE);
         return 0;
+    }
+    case WM_APP_LIVE_DATA:
+        g_live.Drain(hwnd);
+        return 0;
+#if ENERGY_REPORT_TRACE
+    case WM_TIMER:
+        if (wParam == OverlayTimerId) InvalidateOverlay(hwnd);
+        return 0;
+#endif
     case WM_DESTROY:
+        g_live.Stop();
+        // the pooled connections may only go once no send can be using them
+        if (g_spooler.Stop()) g_printers.Close();
+#if ENERGY_REPORT_TRACE
+        KillTimer(hwnd, OverlayTimerId);
+        if (!g_options.tracePath.empty() && !WriteChromeTrace(g_options.tracePath))
+            MessageBox(NULL, (L"Could not write " + g_options.tracePath).c_str(), L"Trace", MB_OK | MB_ICONWARNING);
+        g_traceEtw.Unregister();
+#endif
+        g_sectionCache.Clear();
+#if defined(ER_HAVE_D2D)
+        g_d2d.Shutdown();
+#endif
+        g_gdi.Clear();
         PostQuitMessage(0);
         return 0;
     default:
@@ -203,395 +4867,991 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     }
 }
 
-// Helper for drawing text
-void DrawTextW(HDC hdc, int x, int y, const std::wstring& text, int fontSize = 14, bool bold = false) {
-    HFONT hFont = CreateFontW(-MulDiv(fontSize, GetDeviceCaps(hdc, LOGPIXELSY), 72), 0, 0, 0,
-        bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE,
-        DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-        DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, L"Segoe UI");
-    HFONT old = (HFONT)SelectObject(hdc, hFont);
-    TextOutW(hdc, x, y, text.c_str(), (int)text.size());
-    SelectObject(hdc, old);
-    DeleteObject(hFont);
+// Background, title and rule of a section: everything above kTitleRows
+template <class Schema>
+void DrawSectionTitle(Renderer& r, const RECT& area, SectionId section, const Schema& m) {
+    r.Fill(area, RGB(255,255,255));
+    r.Text(area.left + m.Px(10), area.top + m.Px(10), std::wstring_view(kSections[section].title), 18, true);
+    r.Line(area.left + m.Px(10), area.top + m.Px(36), area.right - m.Px(10), area.top + m.Px(36), m.Px(1), RGB(0,0,0));
 }
 
 // Draw header section: title, building, date and summary box
-void DrawHeader(HDC hdc, RECT& area) {
-    // background white
-    HBRUSH white = (HBRUSH)GetStockObject(WHITE_BRUSH);
-    FillRect(hdc, &area, white);
-    // Title
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Denní energetický report", 18, true);
-    // horizontal line
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN old = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, old);
-    DeleteObject(pen);
+template <class Schema>
+void DrawHeader(Renderer& r, RECT& area) {
+    const EnergyDay& day = CurrentDay();
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionHeader, m);
     // Building and date
-    DrawTextW(hdc, area.left + 10, area.top + 50, std::wstring(g_day.buildingName.begin(), g_day.buildingName.end()), 14, true);
-    std::wstring dateStr = L"Datum: " + formatDate(g_day.date);
-    DrawTextW(hdc, area.left + 10, area.top + 72, dateStr, 12);
+    r.Text(area.left + m.Px(10), area.top + m.Px(50), day.buildingName, 14, true);
+    r.Text(area.left + m.Px(10), area.top + m.Px(72), Label(L"Datum: ").Date(day.date), 12);
     // summary box
-    RECT box = { area.left + 10, area.top + 96, area.right - 10, area.top + 96 + 78 };
-    Rectangle(hdc, box.left, box.top, box.right, box.bottom);
-    // compute stats
-    double total = 0.0;
-    double peak = 0.0;
-    int peakHour = 0;
-    for (size_t i = 0; i < g_day.hourlyKWh.size(); ++i) {
-        total += g_day.hourlyKWh[i];
-        if (g_day.hourlyKWh[i] > peak) {
-            peak = g_day.hourlyKWh[i];
-            peakHour = (int)i;
-        }
-    }
-    double cost = total * g_day.priceCZKPerKWh;
-    std::wostringstream oss;
-    oss << std::fixed << std::setprecision(1) << total;
-    std::wstring totalStr = L"Celkem: " + oss.str() + L" kWh";
-    oss.str(L"");
-    oss << std::fixed << std::setprecision(0) << cost;
-    std::wstring costStr = L"Odhad nákladů: " + oss.str() + L" Kč (";
-    oss.str(L"");
-    oss << std::fixed << std::setprecision(2) << g_day.priceCZKPerKWh;
-    costStr += oss.str() + L" Kč/kWh)";
-    oss.str(L"");
-    oss << std::fixed << std::setprecision(1) << peak;
-    std::wstring peakStr = L"Špička: " + oss.str() + L" kWh @ " + (peakHour < 10 ? L"0" : L"") + std::to_wstring(peakHour) + L":00";
-    DrawTextW(hdc, box.left + 10, box.top + 10, totalStr, 14, true);
-    DrawTextW(hdc, box.left + 10, box.top + 30, costStr, 12);
-    DrawTextW(hdc, box.left + 10, box.top + 50, peakStr, 12);
+    RECT box = { area.left + m.Px(10), area.top + m.Px(96), area.right - m.Px(10), area.top + m.Px(96 + 78) };
+    r.Frame(box, m.Px(1));
+    // precomputed stats
+    double total = day.stats.total;
+    double peak = day.stats.peak;
+    int peakHour = day.stats.peakHour;
+    double cost = total * day.priceCZKPerKWh;
+    r.Text(box.left + m.Px(10), box.top + m.Px(10), Label(L"Celkem: ").Fixed(total, 1).Add(L" kWh"), 14, true);
+    r.Text(box.left + m.Px(10), box.top + m.Px(30),
+        Label(L"Odhad nákladů: ").Fixed(cost, 0).Add(L" Kč (").Fixed(day.priceCZKPerKWh, 2).Add(L" Kč/kWh)"), 12);
+    r.Text(box.left + m.Px(10), box.top + m.Px(50), Label(L"Špička: ").Fixed(peak, 1).Add(L" kWh @ ").Hour(peakHour), 12);
+}
+
+// x of sample i of n in plot: the first sample on the left edge, the last on
+// the right. Hour ticks go through here too, at the index of the hour's
+// first sample, so the series and the grid share one scale.
+int seriesX(const RECT& plot, size_t i, size_t n) {
+    return plot.left + (n > 1 ? (int)((int64_t)(plot.right - plot.left) * (int64_t)i / (int64_t)(n - 1)) : 0);
+}
+
+// Points of a series scaled into plot, reduced to at most four per pixel
+// column: the first, minimum, maximum and last sample of the column, in
+// sample order. Every column spans exactly the pixels the full series would,
+// so one Polyline of the result looks like drawing every sample while the
+// GDI work depends on the plot width only. Sample i sits at
+// seriesX(plot, i, n); 'scale' converts samples to plotted units.
+void decimateMinMax(const double* v, size_t n, const RECT& plot, double yMax, double scale, std::vector<POINT>& out) {
+    out.clear();
+    if (n == 0) return;
+    const int h = plot.bottom - plot.top;
+    auto xOf = [&](size_t i) { return seriesX(plot, i, n); };
+    auto push = [&](size_t i) {
+        POINT pt = { xOf(i), plot.top + (int)(h * (1.0 - v[i] * scale / yMax)) };
+        if (out.empty() || out.back().x != pt.x || out.back().y != pt.y) out.push_back(pt);
+    };
+    size_t first = 0, lo = 0, hi = 0;
+    int column = xOf(0);
+    for (size_t i = 1; i <= n; ++i) {
+        if (i < n && xOf(i) == column) {
+            if (v[i] < v[lo]) lo = i;
+            if (v[i] > v[hi]) hi = i;
+            continue;
+        }
+        // flush the column [first, i)
+        size_t last = i - 1;
+        size_t keep[4] = { first, std::min(lo, hi), std::max(lo, hi), last };
+        for (int k = 0; k < 4; ++k) {
+            if (k == 0 || keep[k] != keep[k - 1]) push(keep[k]);
+        }
+        if (i < n) {
+            first = lo = hi = i;
+            column = xOf(i);
+        }
+    }
 }
 
 // Draw line chart section
-void DrawLineChart(HDC hdc, RECT& area) {
-    FillRect(hdc, &area, (HBRUSH)GetStockObject(WHITE_BRUSH));
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Časová osa (kWh/h)", 18, true);
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
+template <class Schema>
+void DrawLineChart(Renderer& r, RECT& area) {
+    const EnergyDay& day = CurrentDay();
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionLine, m);
     // plot area
     RECT plot;
-    plot.left = area.left + 36;
-    plot.top = area.top + 60;
-    plot.right = area.right - 16;
-    plot.bottom = area.top + 210;
+    plot.left = area.left + m.Px(36);
+    plot.top = area.top + m.Px(60);
+    plot.right = area.right - m.Px(16);
+    plot.bottom = area.top + m.Px(210);
     // bounding box
-    Rectangle(hdc, plot.left, plot.top, plot.right, plot.bottom);
-    double maxV = 10.0;
-    for (double v : g_day.hourlyKWh) if (v > maxV) maxV = v;
+    r.Frame(plot, m.Px(1));
+    // plot the native meter resolution as a kWh/h rate; the hourly buckets
+    // when that is all there is
+    const bool native = day.samplesPerHour > 1 && day.samples.size() == (size_t)day.samplesPerHour * 24;
+    const SampleView& series = native ? day.samples : day.hourlyKWh;
+    const double rate = native ? (double)day.samplesPerHour : 1.0;
+    AggMinMax extremes = aggMinMax(series.data(), series.size());
+    double peak = std::max(extremes.max, 0.0) * rate;
+    double maxV = std::max(10.0, peak);
     double yMax = std::ceil(maxV / 5.0) * 5.0;
     // horizontal grid and labels
-    HPEN gridPen = CreatePen(PS_SOLID, 1, RGB(200,200,200));
-    oldPen = (HPEN)SelectObject(hdc, gridPen);
-    SetBkMode(hdc, TRANSPARENT);
     for (int i = 0; i <= 5; ++i) {
         int y = plot.top + (plot.bottom - plot.top) * i / 5;
-        MoveToEx(hdc, plot.left, y, NULL);
-        LineTo(hdc, plot.right, y);
+        r.Line(plot.left, y, plot.right, y, m.Px(1), RGB(200,200,200));
         double val = yMax * (1.0 - (double)i / 5.0);
-        std::wostringstream oss;
-        oss << std::fixed << std::setprecision(0) << val;
-        std::wstring txt = oss.str();
-        TextOutW(hdc, plot.left - 8 - (int)(txt.size()*7), y - 6, txt.c_str(), (int)txt.size());
-    }
-    SelectObject(hdc, oldPen);
-    DeleteObject(gridPen);
-    // x ticks
-    int ticks[] = {0,6,12,18,23};
-    for (int t : ticks) {
-        int x = plot.left + (plot.right - plot.left) * t / 23;
-        MoveToEx(hdc, x, plot.bottom, NULL);
-        LineTo(hdc, x, plot.bottom + 4);
-        std::wstring txt;
-        txt = (t < 10 ? L"0" : L"") + std::to_wstring(t);
-        TextOutW(hdc, x - 8, plot.bottom + 6, txt.c_str(), (int)txt.size());
-    }
-    // line
-    HPEN linePen = CreatePen(PS_SOLID, 2, RGB(0,0,0));
-    oldPen = (HPEN)SelectObject(hdc, linePen);
-    for (int h = 0; h < (int)g_day.hourlyKWh.size(); ++h) {
-        double val = g_day.hourlyKWh[h];
-        int x = plot.left + (plot.right - plot.left) * h / 23;
-        int y = plot.top + (int)((plot.bottom - plot.top) * (1.0 - val / yMax));
-        if (h == 0) MoveToEx(hdc, x, y, NULL);
-        else LineTo(hdc, x, y);
-    }
-    SelectObject(hdc, oldPen);
-    DeleteObject(linePen);
-    // peak marker
-    double peak = 0;
-    int peakHour = 0;
-    for (int i = 0; i < (int)g_day.hourlyKWh.size(); ++i) {
-        if (g_day.hourlyKWh[i] > peak) {
-            peak = g_day.hourlyKWh[i];
-            peakHour = i;
-        }
+        r.Text(plot.left - m.Px(4), y - m.Px(7), Label().Fixed(val, 0), 10, false, TA_RIGHT);
     }
-    int px = plot.left + (plot.right - plot.left) * peakHour / 23;
+    // x ticks at the first sample of their hour
+    const TickSet& ticks = m.geometry.ticks;
+    const size_t perHour = native ? (size_t)day.samplesPerHour : 1;
+    for (int k = 0; k < ticks.count; ++k) {
+        int t = ticks.hours[k];
+        int x = seriesX(plot, (size_t)t * perHour, series.size());
+        r.Line(x, plot.bottom, x, plot.bottom + m.Px(4), m.Px(1), RGB(0,0,0));
+        r.Text(x - m.Px(8), plot.bottom + m.Px(6), Label().Int(t, 2), 10);
+    }
+    // line: one Polyline over the decimated series
+    thread_local std::vector<POINT> points;
+    decimateMinMax(series.data(), series.size(), plot, yMax, rate, points);
+    r.Polyline(points.data(), points.size(), m.Px(2), RGB(0,0,0));
+    // peak marker on the exact maximum sample, which decimation always keeps
+    size_t peakIndex = extremes.max > 0.0 ? extremes.maxIndex : 0;
+    int px = seriesX(plot, peakIndex, series.size());
     int py = plot.top + (int)((plot.bottom - plot.top) * (1.0 - peak / yMax));
-    HBRUSH black = (HBRUSH)GetStockObject(BLACK_BRUSH);
-    HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, black);
-    Ellipse(hdc, px - 3, py - 3, px + 3, py + 3);
-    SelectObject(hdc, oldBrush);
-    std::wostringstream oss;
-    oss << L"peak " << std::fixed << std::setprecision(1) << peak;
-    std::wstring peakTxt = oss.str();
-    TextOutW(hdc, px + 6, py - 10, peakTxt.c_str(), (int)peakTxt.size());
+    r.Dot(px, py, m.Px(3));
+    r.Text(px + m.Px(6), py - m.Px(10), Label(L"peak ").Fixed(peak, 1), 10);
 }
 
 // Draw bar chart section
-void DrawBarChart(HDC hdc, RECT& area) {
-    FillRect(hdc, &area, (HBRUSH)GetStockObject(WHITE_BRUSH));
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Top spotřebiče (kWh/den)", 18, true);
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
-    const int barAreaYStart = area.top + 60;
-    double maxV = 1.0;
-    for (const auto& c : g_day.topConsumers) if (c.kWh > maxV) maxV = c.kWh;
-    int leftLabelX = area.left + 10;
-    int barX = area.left + 170;
-    int barW = area.right - barX - 10;
-    int y = barAreaYStart;
-    for (size_t i = 0; i < g_day.topConsumers.size(); ++i) {
-        const Consumer& it = g_day.topConsumers[i];
+template <class Schema>
+void DrawBarChart(Renderer& r, RECT& area) {
+    const EnergyDay& day = CurrentDay();
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionBar, m);
+    std::shared_ptr<const PlacedChart> chart = placedChart(ChartBar, area, m);
+    int leftLabelX = area.left + m.Px(10);
+    int barX = area.left + chart->barX;
+    for (size_t i = 0; i < day.topConsumers.size(); ++i) {
+        const Consumer& it = day.topConsumers[i];
+        int y = area.top + chart->barY[i];
         // name
-        std::wstring wname(it.name.begin(), it.name.end());
-        DrawTextW(hdc, leftLabelX, y + 2, wname, 12);
+        r.Text(leftLabelX, y + m.Px(2), it.name, 12);
         // outline
-        Rectangle(hdc, barX, y, barX + barW, y + 18);
+        RECT barRect = { barX, y, barX + chart->barWidth, y + m.Px(18) };
+        r.Frame(barRect, m.Px(1));
         // fill bar proportionally
-        double frac = it.kWh / maxV;
-        int w = (int)(barW * frac);
-        HBRUSH brush = (HBRUSH)GetStockObject(BLACK_BRUSH);
-        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, brush);
-        RECT fillRect = { barX, y, barX + w, y + 18 };
-        FillRect(hdc, &fillRect, brush);
-        SelectObject(hdc, oldBrush);
+        RECT fillRect = { barX, y, barX + chart->barFill[i], y + m.Px(18) };
+        r.Fill(fillRect, RGB(0,0,0));
         // value at right
-        std::wostringstream oss;
-        oss << std::fixed << std::setprecision(1) << it.kWh;
-        std::wstring valStr = oss.str();
-        SIZE size;
-        GetTextExtentPoint32W(hdc, valStr.c_str(), (int)valStr.size(), &size);
-        TextOutW(hdc, area.right - 10 - size.cx, y + 2, valStr.c_str(), (int)valStr.size());
+        r.Text(area.right - m.Px(10), y + m.Px(2), chart->data->barValues[i], 10, false, TA_RIGHT);
         // separator line
-        if (i < g_day.topConsumers.size() - 1) {
-            HPEN sepPen = CreatePen(PS_SOLID, 1, RGB(210,210,210));
-            HPEN old = (HPEN)SelectObject(hdc, sepPen);
-            MoveToEx(hdc, area.left + 10, y + 26, NULL);
-            LineTo(hdc, area.right - 10, y + 26);
-            SelectObject(hdc, old);
-            DeleteObject(sepPen);
+        if (i < day.topConsumers.size() - 1) {
+            r.Line(area.left + m.Px(10), y + m.Px(26), area.right - m.Px(10), y + m.Px(26), m.Px(1), RGB(210,210,210));
         }
-        y += 28;
     }
 }
 
 // Draw pie chart section
-void DrawPieChart(HDC hdc, RECT& area) {
-    FillRect(hdc, &area, (HBRUSH)GetStockObject(WHITE_BRUSH));
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Rozpad kategorií (podíl)", 18, true);
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
-    // compute total
-    double total = 0.0;
-    for (const auto& c : g_day.categoryBreakdown) total += c.kWh;
-    int cx = area.left + 100;
-    int cy = area.top + 170;
-    int radius = 70;
-    double startAngle = -3.14159265358979323846 / 2; // -90 deg
-    // prepare hatch brushes for patterns
-    HBRUSH patterns[4];
-    patterns[0] = CreateHatchBrush(HS_FDIAGONAL, RGB(0,0,0));
-    patterns[1] = CreateHatchBrush(HS_BDIAGONAL, RGB(0,0,0));
-    patterns[2] = CreateHatchBrush(HS_HORIZONTAL, RGB(0,0,0));
-    patterns[3] = CreateHatchBrush(HS_VERTICAL, RGB(0,0,0));
-    // draw slices
-    double currentAngle = startAngle;
-    for (size_t i = 0; i < g_day.categoryBreakdown.size(); ++i) {
-        const auto& cat = g_day.categoryBreakdown[i];
-        double frac = cat.kWh / total;
-        double endAngle = currentAngle + frac * 2 * 3.14159265358979323846;
-        // select pattern
-        HBRUSH hatch = patterns[i % 4];
-        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, hatch);
-        HPEN slicePen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-        HPEN oldP = (HPEN)SelectObject(hdc, slicePen);
-        // draw pie slice using Pie function
-            Pie(hdc, cx - radius, cy - radius, cx + radius, cy + radius,
-            cx + (int)(radius * std::cos(currentAngle)), cy + (int)(radius * std::sin(currentAngle)),
-            cx + (int)(radius * std::cos(endAngle)), cy + (int)(radius * std::sin(endAngle)));
-        SelectObject(hdc, oldP);
-        DeleteObject(slicePen);
-        SelectObject(hdc, oldBrush);
-        currentAngle = endAngle;
+template <class Schema>
+void DrawPieChart(Renderer& r, RECT& area) {
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionPie, m);
+    std::shared_ptr<const PlacedChart> chart = placedChart(ChartPie, area, m);
+    // hatch patterns of the slices
+    const int patterns[4] = { HS_FDIAGONAL, HS_BDIAGONAL, HS_HORIZONTAL, HS_VERTICAL };
+    // draw slices, moved from section to area coordinates
+    for (size_t i = 0; i < chart->wedges.size(); ++i) {
+        PieWedge w = chart->wedges[i];
+        w.cx += area.left;
+        w.cy += area.top;
+        w.from.x += area.left;
+        w.from.y += area.top;
+        w.to.x += area.left;
+        w.to.y += area.top;
+        r.PieSlice(w, patterns[i % 4], m.Px(1));
     }
     // legend
-    int legendY = area.top + 90;
-    for (size_t i = 0; i < g_day.categoryBreakdown.size(); ++i) {
-        const auto& cat = g_day.categoryBreakdown[i];
-        double pct = 100.0 * cat.kWh / total;
+    const int legendX = area.left + chart->legendX;
+    int legendY = area.top + m.Px(90);
+    for (size_t i = 0; i < chart->wedges.size(); ++i) {
+        legendY = area.top + chart->legendY[i];
         // square with pattern number
-        Rectangle(hdc, area.left + 200, legendY, area.left + 212, legendY + 12);
-        std::wstring idx = std::to_wstring(i + 1);
-        TextOutW(hdc, area.left + 202, legendY - 1, idx.c_str(), (int)idx.size());
+        RECT square = { legendX, legendY, legendX + m.Px(12), legendY + m.Px(12) };
+        r.Frame(square, m.Px(1));
+        r.Text(legendX + m.Px(3), legendY - m.Px(1), Label().Int(i + 1), 8);
         // text
-        std::wostringstream oss;
-        oss << (i + 1) << L") " << std::wstring(cat.name.begin(), cat.name.end()) << L"  " << std::fixed << std::setprecision(0) << pct << L"%";
-        std::wstring line = oss.str();
-        TextOutW(hdc, area.left + 218, legendY - 1, line.c_str(), (int)line.size());
-        legendY += 22;
+        r.Text(legendX + m.Px(18), legendY - m.Px(2), chart->data->legend[i], 10);
+        legendY += m.Px(22);
     }
-    TextOutW(hdc, area.left + 200, legendY + 4, L"Pozn.: vzory = index 1..N", 25);
-    // cleanup pattern brushes
-    for (int i = 0; i < 4; ++i) DeleteObject(patterns[i]);
+    r.Text(legendX, legendY + m.Px(4), L"Pozn.: vzory = index 1..N", 10);
 }
 
 // Draw table section
-void DrawTable(HDC hdc, RECT& area) {
-    FillRect(hdc, &area, (HBRUSH)GetStockObject(WHITE_BRUSH));
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Tabulka (výběr hodin)", 18, true);
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
-    double total = 0.0;
-    for (double v : g_day.hourlyKWh) total += v;
-    double avg = total / 24.0;
-    std::wostringstream oss;
-    oss << L"Průměr: " << std::fixed << std::setprecision(1) << avg << L" kWh/h   Cena: " << std::fixed << std::setprecision(2) << g_day.priceCZKPerKWh << L" Kč/kWh";
-    DrawTextW(hdc, area.left + 10, area.top + 50, oss.str(), 12);
-    // top 10 hours
-    struct Row { int hour; double v; };
-    std::vector<Row> rows;
-    for (int i = 0; i < (int)g_day.hourlyKWh.size(); ++i) rows.push_back({ i, g_day.hourlyKWh[i] });
-    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.v > b.v; });
-    if (rows.size() > 10) rows.resize(10);
+template <class Schema>
+void DrawTable(Renderer& r, RECT& area) {
+    const EnergyDay& day = CurrentDay();
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionTable, m);
+    double avg = day.stats.avg;
+    r.Text(area.left + m.Px(10), area.top + m.Px(50),
+        Label(L"Průměr: ").Fixed(avg, 1).Add(L" kWh/h   Cena: ").Fixed(day.priceCZKPerKWh, 2).Add(L" Kč/kWh"), 12);
+    // top 10 hours (ranked once in computeEnergyStats)
+    const int rowCount = day.stats.topCount;
     // header columns
-    int colX[4] = { area.left + 10, area.left + 80, area.left + 160, area.left + 280 };
-    DrawTextW(hdc, colX[0], area.top + 78, L"Hod", 12);
-    DrawTextW(hdc, colX[1], area.top + 78, L"kWh", 12);
-    DrawTextW(hdc, colX[2], area.top + 78, L"Kč", 12);
-    DrawTextW(hdc, colX[3], area.top + 78, L"Pozn.", 12);
+    int colX[TableColumnCount];
+    for (int c = 0; c < TableColumnCount; ++c) {
+        colX[c] = area.left + m.Px(m.geometry.columnX[c]);
+        r.Text(colX[c], area.top + m.Px(78), std::wstring_view(kTableColumns[c]), 12);
+    }
     // header underline
-    pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 82, NULL);
-    LineTo(hdc, area.right - 10, area.top + 82);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
+    r.Line(area.left + m.Px(10), area.top + m.Px(82), area.right - m.Px(10), area.top + m.Px(82), m.Px(1), RGB(0,0,0));
     // rows
-    int y = area.top + 90;
-    for (size_t i = 0; i < rows.size(); ++i) {
-        const Row& r = rows[i];
-        std::wstring hourStr = (r.hour < 10 ? L"0" : L"") + std::to_wstring(r.hour) + L":00";
-        oss.str(L"");
-        oss << std::fixed << std::setprecision(1) << r.v;
-        std::wstring kWhStr = oss.str();
-        oss.str(L"");
-        oss << std::fixed << std::setprecision(0) << (r.v * g_day.priceCZKPerKWh);
-        std::wstring costStr = oss.str();
-        std::wstring noteStr = (r.v > avg * 1.5 ? L"peak" : L"");
-        DrawTextW(hdc, colX[0], y, hourStr, 12);
-        DrawTextW(hdc, colX[1], y, kWhStr, 12);
-        DrawTextW(hdc, colX[2], y, costStr, 12);
-        DrawTextW(hdc, colX[3], y, noteStr, 12);
-        if (i < rows.size() - 1) {
-            HPEN sepPen = CreatePen(PS_SOLID, 1, RGB(220,220,220));
-            HPEN old = (HPEN)SelectObject(hdc, sepPen);
-            MoveToEx(hdc, area.left + 10, y + 18, NULL);
-            LineTo(hdc, area.right - 10, y + 18);
-            SelectObject(hdc, old);
-            DeleteObject(sepPen);
-        }
-        y += 20;
-    }
-    DrawTextW(hdc, area.left + 10, area.bottom - 20, L"Tip: nejvyšší hodiny často souvisí s HVAC/EV.", 12);
+    int y = area.top + m.Px(90);
+    for (int i = 0; i < rowCount; ++i) {
+        int hour = day.stats.topHours[i];
+        double v = day.hourlyKWh[hour];
+        r.Text(colX[0], y, Label().Hour(hour), 12);
+        r.Text(colX[1], y, Label().Fixed(v, 1), 12);
+        r.Text(colX[2], y, Label().Fixed(v * day.priceCZKPerKWh, 0), 12);
+        if (v > avg * 1.5) r.Text(colX[3], y, L"peak", 12);
+        if (i < rowCount - 1) {
+            r.Line(area.left + m.Px(10), y + m.Px(18), area.right - m.Px(10), y + m.Px(18), m.Px(1), RGB(220,220,220));
+        }
+        y += m.Px(20);
+    }
+    r.Text(area.left + m.Px(10), area.bottom - m.Px(20), L"Tip: nejvyšší hodiny často souvisí s HVAC/EV.", 12);
 }
 
 // Draw checklist section
-void DrawChecklist(HDC hdc, RECT& area) {
-    FillRect(hdc, &area, (HBRUSH)GetStockObject(WHITE_BRUSH));
-    DrawTextW(hdc, area.left + 10, area.top + 10, L"Checklist / Alerts", 18, true);
-    HPEN pen = CreatePen(PS_SOLID, 1, RGB(0,0,0));
-    HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-    MoveToEx(hdc, area.left + 10, area.top + 36, NULL);
-    LineTo(hdc, area.right - 10, area.top + 36);
-    SelectObject(hdc, oldPen);
-    DeleteObject(pen);
-    double total = 0.0;
-    for (double v : g_day.hourlyKWh) total += v;
-    double avg = total / 24.0;
-    double peak = 0.0;
-    for (double v : g_day.hourlyKWh) if (v > peak) peak = v;
-    double nightAvg = 0.0;
-    for (int i = 0; i < 6 && i < (int)g_day.hourlyKWh.size(); ++i) nightAvg += g_day.hourlyKWh[i];
-    nightAvg /= 6.0;
-    bool nightHigh = nightAvg > avg * 0.75;
-    struct Alert { std::wstring text; bool ok; };
-    std::vector<Alert> alerts = {
-        { L"Noční zátěž v normě", !nightHigh },
-        { L"Žádná extrémní špička (> 2.0× průměr)", !(peak > avg * 2.0) },
-        { L"Křivka bez výpadků (24/24)", g_day.hourlyKWh.size() == 24 },
-        { L"Doporučení: zkontrolovat HVAC plán", true },
-        { L"Doporučení: audit osvětlení (zóny)", true }
-    };
-    int y = area.top + 60;
-    for (const auto& a : alerts) {
+template <class Schema>
+void DrawChecklist(Renderer& r, RECT& area) {
+    const EnergyDay& day = CurrentDay();
+    const Schema m{};
+    DrawSectionTitle(r, area, SectionChecklist, m);
+    int y = area.top + m.Px(60);
+    for (const AlertSpec& a : kAlerts) {
+        const bool ok = a.ok(day.stats);
         // draw box
-        Rectangle(hdc, area.left + 10, y + 2, area.left + 22, y + 14);
-        if (a.ok) {
-            HPEN okPen = CreatePen(PS_SOLID, 2, RGB(0,0,0));
-            HPEN old = (HPEN)SelectObject(hdc, okPen);
-            MoveToEx(hdc, area.left + 12, y + 9, NULL);
-            LineTo(hdc, area.left + 15, y + 13);
-            LineTo(hdc, area.left + 21, y + 3);
-            SelectObject(hdc, old);
-            DeleteObject(okPen);
+        RECT box = { area.left + m.Px(10), y + m.Px(2), area.left + m.Px(22), y + m.Px(14) };
+        r.Frame(box, m.Px(1));
+        if (ok) {
+            POINT check[3] = { { area.left + m.Px(12), y + m.Px(9) }, { area.left + m.Px(15), y + m.Px(13) }, { area.left + m.Px(21), y + m.Px(3) } };
+            r.Polyline(check, 3, m.Px(2), RGB(0,0,0));
         } else {
-            HPEN crossPen = CreatePen(PS_SOLID, 2, RGB(0,0,0));
-            HPEN old = (HPEN)SelectObject(hdc, crossPen);
-            MoveToEx(hdc, area.left + 12, y + 3, NULL);
-            LineTo(hdc, area.left + 21, y + 13);
-            MoveToEx(hdc, area.left + 21, y + 3, NULL);
-            LineTo(hdc, area.left + 12, y + 13);
-            SelectObject(hdc, old);
-            DeleteObject(crossPen);
+            r.Line(area.left + m.Px(12), y + m.Px(3), area.left + m.Px(21), y + m.Px(13), m.Px(2), RGB(0,0,0));
+            r.Line(area.left + m.Px(21), y + m.Px(3), area.left + m.Px(12), y + m.Px(13), m.Px(2), RGB(0,0,0));
         }
         // text
-        DrawTextW(hdc, area.left + 30, y + 2, a.text, 13, !a.ok);
-        y += 26;
+        r.Text(area.left + m.Px(30), y + m.Px(2), Label(a.text), 13, !ok);
+        y += m.Px(26);
+    }
+}
+
+// ---- Text-mode sections ----
+// Same content as DrawHeader/DrawTable/DrawChecklist in printer fonts. The
+// title and rule come from PrintSectionTitleText, which the print templates
+// precompile.
+void PrintSectionTitleText(const PrinterProfile& profile, int section, std::vector<uint8_t>& out) {
+    const int columns = textColumns(profile);
+    // the report title is printed large
+    escposTextLine(out, kSections[section].title, columns, true, section == SectionHeader);
+    escposTextRule(out, columns);
+}
+
+void PrintHeaderText(const PrinterProfile& profile, std::vector<uint8_t>& out) {
+    const EnergyDay& day = CurrentDay();
+    const int columns = textColumns(profile);
+    wchar_t line[128];
+    escposTextLine(out, std::wstring(day.buildingName), columns, true);
+    escposTextLine(out, L"Datum: " + formatDate(day.date), columns);
+    escposTextRule(out, columns, L'=');
+    swprintf(line, 128, L"Celkem: %.1f kWh", day.stats.total);
+    escposTextLine(out, line, columns, true);
+    swprintf(line, 128, L"Odhad nákladů: %.0f Kč (%.2f Kč/kWh)", day.stats.total * day.priceCZKPerKWh, day.priceCZKPerKWh);
+    escposTextLine(out, line, columns);
+    swprintf(line, 128, L"Špička: %.1f kWh @ %02d:00", day.stats.peak, day.stats.peakHour);
+    escposTextLine(out, line, columns);
+    escposTextRule(out, columns, L'=');
+}
+
+void PrintTableText(const PrinterProfile& profile, std::vector<uint8_t>& out) {
+    const EnergyDay& day = CurrentDay();
+    const int columns = textColumns(profile);
+    const double avg = day.stats.avg;
+    wchar_t line[128];
+    swprintf(line, 128, L"Průměr: %.1f kWh/h   Cena: %.2f Kč/kWh", avg, day.priceCZKPerKWh);
+    escposTextLine(out, line, columns);
+    swprintf(line, 128, L"%-7ls%8ls%8ls  %ls", kTableColumns[0], kTableColumns[1], kTableColumns[2], kTableColumns[3]);
+    escposTextLine(out, line, columns, true);
+    escposTextRule(out, columns);
+    for (int i = 0; i < day.stats.topCount; ++i) {
+        int hour = day.stats.topHours[i];
+        double v = day.hourlyKWh[hour];
+        swprintf(line, 128, L"%02d:00  %8.1f%8.0f  %ls", hour, v, v * day.priceCZKPerKWh, v > avg * 1.5 ? L"peak" : L"");
+        escposTextLine(out, line, columns);
+    }
+    escposTextRule(out, columns);
+    escposTextLine(out, L"Tip: nejvyšší hodiny často souvisí s HVAC/EV.", columns);
+}
+
+void PrintChecklistText(const PrinterProfile& profile, std::vector<uint8_t>& out) {
+    const EnergyStats& stats = CurrentDay().stats;
+    const int columns = textColumns(profile);
+    for (const AlertSpec& a : kAlerts) {
+        const bool ok = a.ok(stats);
+        escposTextLine(out, (ok ? L"[x] " : L"[!] ") + std::wstring(a.text), columns, !ok);
+    }
+}
+
+// Queue a print of the current day. The UI thread only takes a snapshot of
+// g_day; the spooler renders (or reuses the cached raster) and sends it.
+void PrintReport(HWND hwnd) {
+    ER_TRACE_SCOPE(TracePrintSubmit);
+    if (!g_spooler.Start()) return;
+    PrintJob* job = new PrintJob();
+    job->notify = hwnd;
+    job->profile = &printProfile(g_options);
+    job->dither = printDither(g_options, *job->profile);
+    job->toPrinters = g_printers.Count() > 0;
+    job->hybridText = !g_options.rasterPrint;
+    job->rasterKey = PrintSpooler::RasterKey(g_dayRevision, job->profile, job->dither, job->hybridText);
+    job->day = snapshotDay(g_day);
+    if (g_spooler.Submit(job)) EnableWindow(GetDlgItem(hwnd, 2), TRUE);
+}
+
+// Report a finished job
+void FinishPrintJob(PrintJob* job) {
+    g_spooler.Complete(job);
+    if (!g_spooler.Busy()) {
+        SetWindowTextW(GetDlgItem(job->notify, 1), L"Print Report");
+        EnableWindow(GetDlgItem(job->notify, 2), FALSE);
+    }
+    if (job->cancelled) {
+        delete job;
+        return;
+    }
+    wchar_t msg[512];
+    if (job->sent && job->printers.size() > 1) {
+        const RasterStats& rs = job->rasterStats;
+        swprintf(msg, 512, L"ESC/POS report for %ls printer: %u bytes %ls in %.1f ms, sent to %ls.\n"
+            L"Row encoding saved %u bytes (%.0f%%), %d sections printed as text.",
+            job->profile->name, (unsigned)job->bytes->Size(), job->fromCache ? L"reused from cache" : L"built",
+            job->buildMs, job->destination.c_str(), (unsigned)rs.Saved(), rs.plainBytes ? rs.Saved() * 100.0 / rs.plainBytes : 0.0,
+            rs.textSections);
+    } else if (job->sent) {
+        double seconds = job->sendMs / 1000.0;
+        const RasterStats& rs = job->rasterStats;
+        swprintf(msg, 512, L"ESC/POS report for %ls printer: %u bytes %ls in %.1f ms,\nsent to %ls in %.2f s (%.1f KB/s).\n"
+            L"Row encoding saved %u bytes (%.0f%%): %d blank rows fed, %d repeated rows.\n"
+            L"%d sections printed as text (%u bytes).",
+            job->profile->name, (unsigned)job->bytes->Size(), job->fromCache ? L"reused from cache" : L"built",
+            job->buildMs, job->destination.c_str(), seconds,
+            seconds > 0.0 ? job->bytes->Size() / 1024.0 / seconds : 0.0,
+            (unsigned)rs.Saved(), rs.plainBytes ? rs.Saved() * 100.0 / rs.plainBytes : 0.0, rs.blankRows, rs.repeatedRows,
+            rs.textSections, (unsigned)rs.textBytes);
+    } else {
+        swprintf(msg, 512, L"ESC/POS report for %ls printer: %u bytes, but printing to %ls failed: %ls",
+            job->profile->name, job->bytes ? (unsigned)job->bytes->Size() : 0u,
+            job->destination.empty() ? L"printer" : job->destination.c_str(), job->error.c_str());
+    }
+    // this job on every device, then the device's totals
+    std::wstring text = msg;
+    std::vector<PrinterDeviceStats> stats;
+    g_printers.Stats(stats);
+    for (size_t i = 0; i < job->printers.size() && i < stats.size(); ++i) {
+        const PrinterResult& r = job->printers[i];
+        const PrinterDeviceStats& d = stats[i];
+        wchar_t line[256];
+        if (r.sent) {
+            swprintf(line, 256, L"\n%ls: %.2f s%ls; %d jobs, avg %.2f s, %.1f KB/s, MTU %d, %d failed",
+                formatBluetoothAddress(r.address).c_str(), r.sendMs / 1000.0, r.reconnected ? L" after connecting" : L"",
+                d.jobs, d.AverageSendMs() / 1000.0, d.KBPerSecond(), d.mtu, d.failures);
+        } else {
+            swprintf(line, 256, L"\n%ls: failed (%ls); %d jobs, %d failed",
+                formatBluetoothAddress(r.address).c_str(), r.error.c_str(), d.jobs, d.failures);
+        }
+        text += line;
+    }
+    MessageBox(job->notify, text.c_str(), L"Print", MB_OK | (job->sent ? MB_ICONINFORMATION : MB_ICONWARNING));
+    delete job;
+}
+
+// ---- PNG writer ----
+// Just enough of PNG for batch output: 8-bit RGB, "Up" filtered rows and a
+// fixed-Huffman deflate stream whose only matches are byte runs at distance
+// 1 or 3 (one RGB pixel). The report is mostly flat color, so that is
+// already most of the win of real zlib without a dependency.
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size) {
+    // built once; batch workers call this concurrently
+    struct Table {
+        uint32_t v[256];
+        Table() {
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                v[n] = c;
+            }
+        }
+    };
+    static const Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table.v[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+class DeflateBits {
+public:
+    explicit DeflateBits(std::vector<uint8_t>& out) : out(out) {}
+    // value LSB first, as deflate stores extra bits
+    void Put(uint32_t value, int count) {
+        acc |= (uint64_t)value << bits;
+        bits += count;
+        while (bits >= 8) {
+            out.push_back((uint8_t)acc);
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    // Huffman codes are stored MSB first
+    void PutCode(uint32_t code, int count) {
+        uint32_t r = 0;
+        for (int i = 0; i < count; ++i) r |= ((code >> i) & 1) << (count - 1 - i);
+        Put(r, count);
+    }
+    void Flush() {
+        if (bits > 0) out.push_back((uint8_t)acc);
+        acc = 0;
+        bits = 0;
+    }
+private:
+    std::vector<uint8_t>& out;
+    uint64_t acc = 0;
+    int bits = 0;
+};
+
+// Fixed Huffman literal/length code of symbol 0..287
+void deflateSymbol(DeflateBits& bw, int sym) {
+    if (sym < 144) bw.PutCode(0x30 + sym, 8);
+    else if (sym < 256) bw.PutCode(0x190 + sym - 144, 9);
+    else if (sym < 280) bw.PutCode(sym - 256, 7);
+    else bw.PutCode(0xC0 + sym - 280, 8);
+}
+
+void deflateMatch(DeflateBits& bw, int length, int distance) {
+    static const int kBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int kExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    int code = 28;
+    while (kBase[code] > length) --code;
+    deflateSymbol(bw, 257 + code);
+    bw.Put(length - kBase[code], kExtra[code]);
+    bw.PutCode(distance - 1, 5); // distance codes 0..3 are the distances 1..4, no extra bits
+}
+
+// zlib stream of data
+void zlibCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    out.push_back(0x78);
+    out.push_back(0x01);
+    DeflateBits bw(out);
+    bw.Put(1, 1); // final block
+    bw.Put(1, 2); // fixed Huffman
+    size_t i = 0;
+    while (i < size) {
+        int best = 0, bestDist = 0;
+        for (int dist : { 1, 3 }) {
+            if (i < (size_t)dist) continue;
+            int len = 0;
+            while (len < 258 && i + len < size && data[i + len] == data[i + len - dist]) ++len;
+            if (len > best) {
+                best = len;
+                bestDist = dist;
+            }
+        }
+        if (best >= 3) {
+            deflateMatch(bw, best, bestDist);
+            i += best;
+        } else {
+            deflateSymbol(bw, data[i++]);
+        }
+    }
+    deflateSymbol(bw, 256);
+    bw.Flush();
+    uint32_t a = 1, b = 0;
+    for (size_t k = 0; k < size; ++k) {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(adler >> shift));
+}
+
+void pngChunk(std::vector<uint8_t>& out, const char type[4], const uint8_t* data, size_t size) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(size >> shift));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    uint32_t crc = crc32Update(0, out.data() + start, out.size() - start);
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(crc >> shift));
+}
+
+// Encode the first 'height' rows of a raster as an RGB PNG into out
+void encodePng(const ColorRaster& raster, int height, std::vector<uint8_t>& out) {
+    const int width = raster.Width();
+    const size_t stride = (size_t)width * 3;
+    std::vector<uint8_t> filtered((stride + 1) * height);
+    std::vector<uint8_t> prev(stride, 0), row(stride);
+    for (int y = 0; y < height; ++y) {
+        const uint32_t* src = raster.Row(y);
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = (uint8_t)(src[x] >> 16);
+            row[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+            row[x * 3 + 2] = (uint8_t)src[x];
+        }
+        uint8_t* dst = &filtered[(stride + 1) * y];
+        dst[0] = 2; // Up
+        for (size_t i = 0; i < stride; ++i) dst[1 + i] = (uint8_t)(row[i] - prev[i]);
+        prev.swap(row);
+    }
+    out.clear();
+    static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.insert(out.end(), kSignature, kSignature + 8);
+    const uint8_t ihdr[13] = { (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 2, 0, 0, 0 }; // 8-bit RGB, no interlace
+    pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+    std::vector<uint8_t> idat;
+    zlibCompress(filtered.data(), filtered.size(), idat);
+    pngChunk(out, "IDAT", idat.data(), idat.size());
+    pngChunk(out, "IEND", nullptr, 0);
+}
+
+// ---- Headless batch mode ----
+// --batch renders one report per building without creating a window: every
+// building of the --store for --day, or --count simulated buildings. Worker
+// threads pull buildings from a shared counter; each owns its GDI cache,
+// memory DCs and output buffer, so nothing is shared but the read-only store.
+enum BatchFormat { BatchNone, BatchEscPos, BatchPng };
+
+static const int kBatchPageWidth = 584; // client width of the default window
+
+struct BatchRun {
+    const AppOptions* options;
+    BatchFormat format;
+    uint32_t items;
+    std::atomic<uint32_t> next{ 0 };
+    std::atomic<uint32_t> failed{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+// Write to the console the batch was started from, or to the redirected
+// stdout/stderr (stream is STD_OUTPUT_HANDLE or STD_ERROR_HANDLE)
+void consolePrintV(DWORD stream, const wchar_t* format, va_list args) {
+    wchar_t text[512];
+    int len = vswprintf(text, 512, format, args);
+    if (len <= 0) return;
+    HANDLE out = GetStdHandle(stream);
+    if (!out || out == INVALID_HANDLE_VALUE) return;
+    DWORD mode, n;
+    if (GetConsoleMode(out, &mode)) {
+        WriteConsoleW(out, text, (DWORD)len, &n, NULL);
+    } else {
+        char utf8[1536];
+        int bytes = WideCharToMultiByte(CP_UTF8, 0, text, len, utf8, sizeof(utf8), NULL, NULL);
+        if (bytes > 0) WriteFile(out, utf8, (DWORD)bytes, &n, NULL);
+    }
+}
+
+void batchPrint(const wchar_t* format, ...) {
+    va_list args;
+    va_start(args, format);
+    consolePrintV(STD_OUTPUT_HANDLE, format, args);
+    va_end(args);
+}
+
+// Progress and diagnostics: stderr, so a redirected stdout stays clean
+void consoleError(const wchar_t* format, ...) {
+    va_list args;
+    va_start(args, format);
+    consolePrintV(STD_ERROR_HANDLE, format, args);
+    va_end(args);
+}
+
+// Draw the whole report into a memory DC with the bound layout
+bool renderReportPage(ColorRaster& page, int& height) {
+    const ReportLayout& layout = CurrentLayout();
+    height = layout.height;
+    if (!page.Resize(layout.width, height)) return false;
+    page.Clear();
+    GdiRenderer gdi(page.Dc());
+    for (int i = 0; i < SectionCount; ++i) {
+        RECT area = layout.sections[i];
+        drawSection(gdi, i, area);
+    }
+    GdiFlush();
+    return true;
+}
+
+DWORD WINAPI BatchWorker(LPVOID param) {
+    BatchRun& run = *(BatchRun*)param;
+    const AppOptions& opts = *run.options;
+    GdiCache gdi;
+    PrintRasters rasters;
+    ColorRaster page;
+    const ReportLayout layout = LayoutReport(kBatchPageWidth);
+    RasterStats stats;
+    std::vector<uint8_t> out;
+    for (uint32_t i = run.next++; i < run.items; i = run.next++) {
+        EnergyDay day;
+        if (g_store.IsOpen()) {
+            day = g_store.Day(i, opts.day);
+        } else {
+            day = simulateEnergyDay(opts.seed + i);
+            day.buildingName = internName("Budova " + std::to_string(i + 1));
+        }
+        ScopedRenderBinding bind(&day, &gdi, &layout, false); // each day is drawn once
+        bool ok = true;
+        const wchar_t* ext = nullptr;
+        int height = 0;
+        if (run.format == BatchEscPos) {
+            const PrinterProfile& profile = printProfile(opts);
+            ok = BuildEscPosReport(profile, printDither(opts, profile), !opts.rasterPrint, rasters, out, stats);
+            ext = L"escpos";
+        } else {
+            ok = renderReportPage(page, height);
+            if (ok && run.format == BatchPng) {
+                encodePng(page, height, out);
+                ext = L"png";
+            }
+        }
+        if (ok && ext) {
+            wchar_t name[64];
+            swprintf(name, 64, L"\\report_%04u_%04u%02u%02u.%ls", i, day.date.wYear, day.date.wMonth, day.date.wDay, ext);
+            FileTransport file(opts.batchDir + name);
+            ok = file.Send(out.data(), out.size(), NULL);
+            if (ok) run.bytes += out.size();
+        }
+        if (!ok) run.failed++;
+    }
+    return 0;
+}
+
+// Run the batch and report the wall time; the exit code is 0 when every
+// report was written
+int RunBatch(const AppOptions& opts) {
+    AttachConsole(ATTACH_PARENT_PROCESS);
+    BatchRun run;
+    run.options = &opts;
+    run.format = opts.batchFormat == L"png" ? BatchPng : opts.batchFormat == L"none" ? BatchNone : BatchEscPos;
+    if (!opts.storePath.empty()) {
+        if (!g_store.Open(opts.storePath, false) || opts.day >= g_store.DayCount()) {
+            batchPrint(L"Could not open the time-series store %ls for day %u\n", opts.storePath.c_str(), opts.day);
+            return 2;
+        }
+        run.items = g_store.BuildingCount();
+    } else {
+        run.items = opts.count;
+    }
+    CreateDirectoryW(opts.batchDir.c_str(), NULL);
+    uint32_t workers = opts.jobs;
+    if (!workers) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        workers = si.dwNumberOfProcessors;
+    }
+    workers = std::max(1u, std::min(workers, std::max(run.items, 1u)));
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    std::vector<HANDLE> threads;
+    for (uint32_t w = 0; w < workers; ++w) {
+        HANDLE thread = CreateThread(NULL, 0, BatchWorker, &run, 0, NULL);
+        if (thread) threads.push_back(thread);
+    }
+    // an empty pool still finishes the batch, on this thread
+    if (threads.empty()) BatchWorker(&run);
+    for (HANDLE thread : threads) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    double seconds = secondsSince(start);
+    batchPrint(L"%u reports (%ls) with %u workers in %.2f s: %.1f reports/s, %.1f MB written, %u failed\n",
+        run.items, opts.batchFormat.c_str(), (unsigned)threads.size(), seconds, seconds > 0.0 ? run.items / seconds : 0.0,
+        run.bytes / (1024.0 * 1024.0), (unsigned)run.failed);
+    return run.failed ? 1 : 0;
+}
+
+// --generate: write a synthetic store and report the generation rate
+int RunGenerate(const AppOptions& opts) {
+    AttachConsole(ATTACH_PARENT_PROCESS);
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    TimeSeriesStore store;
+    if (!GenerateSyntheticStore(opts.generatePath, opts.seed, std::max(opts.count, 1u), opts.generateDays,
+            opts.samplesPerDay, opts.jobs, store)) {
+        batchPrint(L"Could not create a store of %u x %u days at %u samples/day in %ls\n",
+            std::max(opts.count, 1u), opts.generateDays, opts.samplesPerDay, opts.generatePath.c_str());
+        return 2;
+    }
+    double seconds = secondsSince(start);
+    double samples = (double)store.BuildingCount() * store.DayCount() * store.SamplesPerDay();
+    batchPrint(L"%u buildings x %u days x %u samples in %.2f s: %.1f M samples/s\n", store.BuildingCount(),
+        store.DayCount(), store.SamplesPerDay(), seconds, seconds > 0.0 ? samples / seconds / 1e6 : 0.0);
+    return 0;
+}
+
+#if defined(ENERGY_REPORT_BENCHMARK)
+// ---- Benchmark suite ----
+// Built from this file with -DENERGY_REPORT_BENCHMARK as a console program
+// (EnergyReportBench.exe, see build-windows.yml). Every case runs once to
+// warm caches, then is timed per iteration with QueryPerformanceCounter;
+// the JSON report carries median/p99/min, heap allocations and GDI objects
+// gained per iteration, so two releases can be diffed case by case.
+//   --iterations <n>  timed runs per case (default 200)
+//   --filter <text>   only cases whose name contains text
+//   --out <file>      write the JSON there instead of stdout
+// Progress lines go to stderr, so "EnergyReportBench > bench.json" works.
+
+// Every allocation of the process goes through here in the benchmark build
+static std::atomic<uint64_t> g_benchAllocations{ 0 };
+
+void* operator new(size_t size) {
+    g_benchAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+struct BenchResult {
+    std::string name;
+    int iterations;
+    double medianUs, p99Us, minUs;
+    double allocsPerIteration;
+    double gdiObjectsPerIteration; // leaks show up here, fractions included
+    size_t outputBytes;           // encoders: size of one result
+};
+
+class BenchSuite {
+public:
+    BenchSuite(int iterations, const std::wstring& filter) : iterations(std::max(1, iterations)), filter(filter) {}
+
+    // body() returns the bytes it produced (0 when that means nothing)
+    template <class Body> void Run(const std::string& name, Body body) {
+        if (!filter.empty() && std::wstring(name.begin(), name.end()).find(filter) == std::wstring::npos) return;
+        size_t bytes = body();
+        samples.assign(iterations, 0.0);
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        const DWORD gdiBefore = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+        const uint64_t allocsBefore = g_benchAllocations.load();
+        for (int i = 0; i < iterations; ++i) {
+            LARGE_INTEGER t0, t1;
+            QueryPerformanceCounter(&t0);
+            body();
+            QueryPerformanceCounter(&t1);
+            samples[i] = (double)(t1.QuadPart - t0.QuadPart) * 1e6 / (double)freq.QuadPart;
+        }
+        const uint64_t allocs = g_benchAllocations.load() - allocsBefore;
+        const DWORD gdiAfter = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+        std::sort(samples.begin(), samples.end());
+        size_t p99 = std::min(samples.size() - 1, (size_t)std::ceil(samples.size() * 0.99) - 1);
+        results.push_back({ name, iterations, samples[samples.size() / 2], samples[p99], samples[0],
+            (double)allocs / iterations, ((double)gdiAfter - (double)gdiBefore) / iterations, bytes });
+        // stdout may carry the JSON
+        consoleError(L"%-40hs %10.1f us median %10.1f us p99 %8.2f allocs\n", name.c_str(),
+            results.back().medianUs, results.back().p99Us, results.back().allocsPerIteration);
+    }
+
+    std::string Json() const {
+        std::string json = "{\n  \"schema\": 1,\n";
+        char line[512];
+        snprintf(line, sizeof(line), "  \"avx2\": %s,\n  \"gdiObjects\": %lu,\n  \"results\": [\n",
+            cpuHasAvx2() ? "true" : "false", (unsigned long)GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS));
+        json += line;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult& r = results[i];
+            snprintf(line, sizeof(line),
+                "    { \"name\": \"%s\", \"iterations\": %d, \"median_us\": %.3f, \"p99_us\": %.3f, \"min_us\": %.3f, "
+                "\"allocs_per_iter\": %.2f, \"gdi_objects_per_iter\": %.3f, \"bytes\": %zu }%s\n",
+                r.name.c_str(), r.iterations, r.medianUs, r.p99Us, r.minUs, r.allocsPerIteration,
+                r.gdiObjectsPerIteration, r.outputBytes, i + 1 < results.size() ? "," : "");
+            json += line;
+        }
+        json += "  ]\n}\n";
+        return json;
+    }
+
+private:
+    int iterations;
+    std::wstring filter;
+    std::vector<double> samples;
+    std::vector<BenchResult> results;
+};
+
+static const char* const kSectionNames[SectionCount] = { "header", "line", "bar", "pie", "table", "checklist" };
+
+// Each Draw* into a memory DC, per backend, width and DPI
+void benchDrawing(BenchSuite& suite, const EnergyDay& day) {
+    const struct { int width, dpi; } sizes[] = { { 384, 96 }, { 600, 96 }, { 600, 144 }, { 1200, 192 } };
+    GdiCache gdi;
+    ColorRaster target;
+#if defined(ER_HAVE_D2D)
+    const bool d2d = g_d2d.Init();
+#endif
+    for (const auto& size : sizes) {
+        const ReportLayout layout = LayoutReport(size.width, size.dpi);
+        ScopedRenderBinding bind(&day, &gdi, &layout);
+        for (int i = 0; i < SectionCount; ++i) {
+            RECT area = { 0, 0, layout.sections[i].right - layout.sections[i].left, layout.sections[i].bottom - layout.sections[i].top };
+            if (!target.Resize(area.right, area.bottom)) continue;
+            char name[96];
+            snprintf(name, sizeof(name), "draw/%s/gdi/%dx%d@%d", kSectionNames[i], area.right, area.bottom, size.dpi);
+            suite.Run(name, [&]() -> size_t {
+                GdiRenderer r(target.Dc());
+                kSections[i].draw(r, area);
+                GdiFlush();
+                return 0;
+            });
+#if defined(ER_HAVE_D2D)
+            if (!d2d) continue;
+            snprintf(name, sizeof(name), "draw/%s/d2d/%dx%d@%d", kSectionNames[i], area.right, area.bottom, size.dpi);
+            suite.Run(name, [&]() -> size_t {
+                if (g_d2d.Begin(target.Dc(), area)) {
+                    kSections[i].draw(g_d2d, area);
+                    g_d2d.End();
+                }
+                return 0;
+            });
+#endif
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "draw/page/gdi/%d@%d", size.width, size.dpi);
+        ColorRaster page;
+        suite.Run(name, [&]() -> size_t {
+            int height = 0;
+            renderReportPage(page, height);
+            return 0;
+        });
+    }
+#if defined(ER_HAVE_D2D)
+    g_d2d.Shutdown();
+#endif
+}
+
+// ESC/POS jobs per printer profile, raster-only and hybrid, and the PNG page
+void benchEncoders(BenchSuite& suite, const EnergyDay& day) {
+    GdiCache gdi;
+    const ReportLayout layout = LayoutReport(kBatchPageWidth);
+    ScopedRenderBinding bind(&day, &gdi, &layout);
+    PrintRasters rasters;
+    std::vector<uint8_t> out;
+    RasterStats stats;
+    const struct { const char* name; const PrinterProfile* profile; } printers[] = {
+        { "58mm", &kPrinter58mm }, { "80mm", &kPrinter80mm }, { "star80mm", &kPrinterStar80mm }
+    };
+    for (const auto& p : printers) {
+        for (int hybrid = 0; hybrid < 2; ++hybrid) {
+            char name[64];
+            snprintf(name, sizeof(name), "escpos/%s/%s", p.name, hybrid ? "hybrid" : "raster");
+            suite.Run(name, [&]() -> size_t {
+                BuildEscPosReport(*p.profile, p.profile->dither, hybrid != 0, rasters, out, stats);
+                return out.size();
+            });
+        }
+    }
+    ColorRaster page;
+    int height = 0;
+    renderReportPage(page, height);
+    suite.Run("png/page", [&]() -> size_t {
+        encodePng(page, height, out);
+        return out.size();
+    });
+}
+
+// Simulation, statistics and the aggregation kernels over a month of
+// one-minute samples
+void benchData(BenchSuite& suite) {
+    uint64_t seed = 1;
+    suite.Run("simulateEnergyDay", [&]() -> size_t {
+        EnergyDay day = simulateEnergyDay(seed++);
+        return day.hourlyKWh.size();
+    });
+    EnergyDay day = simulateEnergyDay();
+    suite.Run("computeEnergyStats", [&]() -> size_t {
+        computeEnergyStats(day);
+        return 0;
+    });
+    LoadModel model(1, 1440);
+    std::vector<double> shape(1440, 16.0), minutes(1440);
+    int64_t modelDay = 0;
+    suite.Run("simulateLoad/1440/scalar", [&]() -> size_t {
+        simulateLoadScalar(shape.data(), minutes.size(), CounterRNG::Key(1, 0, modelDay++), 1.0 / 60, minutes.data());
+        return minutes.size() * sizeof(double);
+    });
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) {
+        suite.Run("simulateLoad/1440/avx2", [&]() -> size_t {
+            simulateLoadAvx2(shape.data(), minutes.size(), CounterRNG::Key(1, 0, modelDay++), 1.0 / 60, minutes.data());
+            return minutes.size() * sizeof(double);
+        });
     }
+#endif
+    suite.Run("LoadModel::Day/1440", [&]() -> size_t {
+        model.Day(0, modelDay++, minutes.data());
+        return minutes.size() * sizeof(double);
+    });
+    // a one-minute day round-tripped through a snapshot file in %TEMP%
+    EnergyDay minuteDay = day;
+    SampleBuffer minuteSamples = SampleBuffer::Allocate(1440), minuteHourly = SampleBuffer::Allocate(24);
+    model.Day(0, 0, minuteSamples.data());
+    aggResample(minuteSamples.data(), 24, 60, minuteHourly.data());
+    minuteDay.samples = minuteSamples;
+    minuteDay.samplesPerHour = 60;
+    minuteDay.hourlyKWh = minuteHourly;
+    computeEnergyStats(minuteDay);
+    wchar_t temp[MAX_PATH];
+    std::wstring snapshotPath = std::wstring(GetTempPathW(MAX_PATH, temp) ? temp : L"") + L"EnergyReportBench.ersnap";
+    ReportSnapshot snapshot;
+    if (ReportSnapshot::Write(snapshotPath, { &minuteDay }) && snapshot.Open(snapshotPath)) {
+        suite.Run("ReportSnapshot::Day/1440", [&]() -> size_t {
+            EnergyDay replay = snapshot.Day(0);
+            return replay.samples.size() * sizeof(float);
+        });
+        snapshot.Close();
+    }
+    DeleteFileW(snapshotPath.c_str());
+    std::vector<double> v(31 * 1440);
+    SeededRNG rng(7);
+    for (double& x : v) x = rng.nextDouble01() * 2.0;
+    volatile double sink = 0.0;
+    suite.Run("agg/sum/scalar", [&]() -> size_t { sink = aggSumScalar(v.data(), v.size()); return 0; });
+    suite.Run("agg/minmax/scalar", [&]() -> size_t { sink = aggMinMaxScalar(v.data(), v.size()).max; return 0; });
+    suite.Run("agg/countAbove/scalar", [&]() -> size_t { sink = (double)aggCountAboveScalar(v.data(), v.size(), 1.5); return 0; });
+#if defined(ER_HAVE_X86_SIMD)
+    if (cpuHasAvx2()) {
+        suite.Run("agg/sum/avx2", [&]() -> size_t { sink = aggSumAvx2(v.data(), v.size()); return 0; });
+        suite.Run("agg/minmax/avx2", [&]() -> size_t { sink = aggMinMaxAvx2(v.data(), v.size()).max; return 0; });
+        suite.Run("agg/countAbove/avx2", [&]() -> size_t { sink = (double)aggCountAboveAvx2(v.data(), v.size(), 1.5); return 0; });
+    }
+#endif
+    std::vector<double> scratch;
+    suite.Run("agg/percentile95", [&]() -> size_t { sink = aggPercentile(v.data(), v.size(), 0.95, scratch); return 0; });
+    (void)sink;
 }
 
-// Stub: generate ESC/POS commands for the report and write to a file
-void PrintReport() {
-    MessageBox(NULL, L"Print functionality is not fully implemented in this demo.\nThis stub would send ESC/POS commands to your printer.", L"Print", MB_OK | MB_ICONINFORMATION);
-    // You could generate the ESC/POS data here by rasterizing each chart to a monochrome bitmap
-    // and writing the ESC/POS commands to a file or serial port. See the JS version for reference.
+int wmain(int argc, wchar_t** argv) {
+    int iterations = 200;
+    std::wstring filter, outPath;
+    for (int i = 1; i < argc; ++i) {
+        std::wstring arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == L"--iterations" && hasValue) iterations = (int)wcstoul(argv[++i], NULL, 10);
+        else if (arg == L"--filter" && hasValue) filter = argv[++i];
+        else if (arg == L"--out" && hasValue) outPath = argv[++i];
+    }
+    BenchSuite suite(iterations, filter);
+    const EnergyDay day = simulateEnergyDay();
+    benchData(suite);
+    benchDrawing(suite, day);
+    benchEncoders(suite, day);
+    std::string json = suite.Json();
+    if (outPath.empty()) {
+        DWORD n = 0;
+        WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), json.data(), (DWORD)json.size(), &n, NULL);
+        return 0;
+    }
+    FileTransport file(outPath);
+    if (!file.Send((const uint8_t*)json.data(), json.size(), NULL)) {
+        consoleError(L"Could not write %ls\n", outPath.c_str());
+        return 1;
+    }
+    return 0;
 }
 
+#else
 // Main entry point
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrev, PWSTR pCmdLine, int nCmdShow) {
     // Initialize common controls (for button styles)
     INITCOMMONCONTROLSEX icc = { sizeof(INITCOMMONCONTROLSEX), ICC_STANDARD_CLASSES };
     InitCommonControlsEx(&icc);
+    ParseOptions(g_options);
+    g_printers.Configure(g_options.printers);
+#if ENERGY_REPORT_TRACE
+    g_traceEtw.Register();
+#endif
+    if (!g_options.generatePath.empty()) return RunGenerate(g_options);
+    if (!g_options.batchDir.empty()) return RunBatch(g_options);
+    EnablePerMonitorDpi();
     const wchar_t CLASS_NAME[] = L"EnergyReportWindow";
     WNDCLASS wc = {};
     wc.lpfnWndProc = WndProc;
@@ -606,7 +5866,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrev, PWSTR pCmdLine, int nC
         0,
         CLASS_NAME,
         L"Energetický report",
-        WS_OVERLAPPEDWINDOW,
+        WS_OVERLAPPEDWINDOW | WS_VSCROLL | WS_CLIPCHILDREN,
         CW_USEDEFAULT, CW_USEDEFAULT,
         600, 1100,
         NULL,
@@ -615,12 +5875,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrev, PWSTR pCmdLine, int nC
         NULL
     );
     if (!hwnd) return 0;
+    // the default size is in 96-DPI units too
+    int dpi = WindowDpi(hwnd);
+    if (dpi != 96) SetWindowPos(hwnd, NULL, 0, 0, MulDiv(600, dpi, 96), MulDiv(1100, dpi, 96), SWP_NOMOVE | SWP_NOZORDER);
     ShowWindow(hwnd, nCmdShow);
     // message loop
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0)) {
+#if ENERGY_REPORT_TRACE
+        // checked here because the buttons have the keyboard focus
+        if (msg.message == WM_KEYDOWN && msg.wParam == VK_F9) {
+            ToggleOverlay(hwnd);
+            continue;
+        }
+#endif
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
     return 0;
 }
+#endif